@@ -5,6 +5,7 @@
 
 #include "command.h"
 #include "render.h"
+#include "stats.h"
 
 // Convert 2 little-endian 8bit bytes to a 16bit integer
 static uint16_t decodeInt16(uint8_t *data, uint8_t start) {
@@ -56,7 +57,9 @@ int process_command(uint8_t *data, uint32_t size) {
           {decodeInt16(recv_buf, 5), decodeInt16(recv_buf, 7)}, // size w/h
           {recv_buf[9], recv_buf[10], recv_buf[11]}};           // color r/g/b
 
+      stats_begin();
       draw_rectangle(&rectcmd);
+      stats_end(stats_draw_rectangle);
       return 1;
     }
 
@@ -79,7 +82,9 @@ int process_command(uint8_t *data, uint32_t size) {
           {decodeInt16(recv_buf, 2), decodeInt16(recv_buf, 4)}, // position x/y
           {recv_buf[6], recv_buf[7], recv_buf[8]},    // foreground r/g/b
           {recv_buf[9], recv_buf[10], recv_buf[11]}}; // background r/g/b
+      stats_begin();
       draw_character(&charcmd);
+      stats_end(stats_draw_character);
       return 1;
     }
 
@@ -109,7 +114,9 @@ int process_command(uint8_t *data, uint32_t size) {
 
       osccmd.waveform_size = size - 4;
 
+      stats_begin();
       draw_waveform(&osccmd);
+      stats_end(stats_draw_waveform);
       return 1;
     }
 
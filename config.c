@@ -25,6 +25,8 @@ config_params_s init_config() {
   c.init_fullscreen = 0; // default fullscreen state at load
   c.init_use_gpu = 1;    // default to use hardware acceleration
   c.idle_ms = 10;        // default to high performance
+  c.frame_pacing = 0;    // default to present once per main loop iteration
+  c.low_power_idle = 0;  // default to never slow down the main loop
   c.wait_for_device = 0; // default to exit if device disconnected
   c.wait_packets = 1024;   // default zero-byte attempts to disconnect (about 2 sec for default idle_ms)
 
@@ -77,7 +79,7 @@ void write_config(config_params_s *conf) {
 
   SDL_Log("Writing config file to %s", config_path);
 
-  const unsigned int INI_LINE_COUNT = 40;
+  const unsigned int INI_LINE_COUNT = 42;
   const unsigned int LINELEN = 50;
 
   // Entries for the config file
@@ -89,6 +91,10 @@ void write_config(config_params_s *conf) {
   snprintf(ini_values[initPointer++], LINELEN, "use_gpu=%s\n",
            conf->init_use_gpu ? "true" : "false");
   snprintf(ini_values[initPointer++], LINELEN, "idle_ms=%d\n", conf->idle_ms);
+  snprintf(ini_values[initPointer++], LINELEN, "frame_pacing=%s\n",
+           conf->frame_pacing ? "true" : "false");
+  snprintf(ini_values[initPointer++], LINELEN, "low_power_idle=%s\n",
+           conf->low_power_idle ? "true" : "false");
   snprintf(ini_values[initPointer++], LINELEN, "wait_for_device=%s\n",
            conf->wait_for_device ? "true" : "false");
   snprintf(ini_values[initPointer++], LINELEN, "wait_packets=%d\n", conf->wait_packets);
@@ -205,6 +211,8 @@ void read_graphics_config(ini_t *ini, config_params_s *conf) {
   const char *param_fs = ini_get(ini, "graphics", "fullscreen");
   const char *param_gpu = ini_get(ini, "graphics", "use_gpu");
   const char *idle_ms = ini_get(ini, "graphics", "idle_ms");
+  const char *param_pacing = ini_get(ini, "graphics", "frame_pacing");
+  const char *param_idle = ini_get(ini, "graphics", "low_power_idle");
   const char *param_wait = ini_get(ini, "graphics", "wait_for_device");
   const char *wait_packets = ini_get(ini, "graphics", "wait_packets");
 
@@ -223,6 +231,20 @@ void read_graphics_config(ini_t *ini, config_params_s *conf) {
   if (idle_ms != NULL)
     conf->idle_ms = SDL_atoi(idle_ms);
 
+  if (param_pacing != NULL) {
+    if (strcmpci(param_pacing, "true") == 0) {
+      conf->frame_pacing = 1;
+    } else
+      conf->frame_pacing = 0;
+  }
+
+  if (param_idle != NULL) {
+    if (strcmpci(param_idle, "true") == 0) {
+      conf->low_power_idle = 1;
+    } else
+      conf->low_power_idle = 0;
+  }
+
   if (param_wait != NULL) {
     if (strcmpci(param_wait, "true") == 0) {
       conf->wait_for_device = 1;
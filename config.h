@@ -11,6 +11,8 @@ typedef struct config_params_s {
   int init_fullscreen;
   int init_use_gpu;
   int idle_ms;
+  int frame_pacing;
+  int low_power_idle;
   int wait_for_device;
   int wait_packets;
 
@@ -0,0 +1,107 @@
+// Serial I/O for running several M8s from one process. Every device is read
+// in its own thread so a slow or stuck port never blocks rendering, and the
+// bytes are handed over to the main thread through a queue.
+
+#include "device.h"
+
+#include <SDL_log.h>
+#include <string.h>
+#include <time.h>
+
+#define device_read_size 1024
+#define device_read_timeout_ms 50
+
+static void *device_threadproc(void *arg) {
+  m8_device_s *device = arg;
+  uint8_t buf[device_read_size];
+
+  while (device->running) {
+    int n = sp_blocking_read(device->port, buf, sizeof(buf),
+                             device_read_timeout_ms);
+    if (n < 0) {
+      SDL_LogError(SDL_LOG_CATEGORY_SYSTEM, "Device %d: error %d reading serial",
+                   device->index, n);
+      pthread_mutex_lock(&device->lock);
+      device->failed = 1;
+      pthread_mutex_unlock(&device->lock);
+      break;
+    }
+
+    uint8_t *cur = buf;
+    while (n > 0 && device->running) {
+      pthread_mutex_lock(&device->lock);
+      int space = device_queue_size - device->queued;
+      int count = n < space ? n : space;
+      memcpy(&device->queue[device->queued], cur, count);
+      device->queued += count;
+      pthread_mutex_unlock(&device->lock);
+
+      cur += count;
+      n -= count;
+
+      // The main thread is behind, wait for it rather than drop data
+      if (n > 0) {
+        struct timespec request = {0, 1000000};
+        nanosleep(&request, NULL);
+      }
+    }
+  }
+
+  return NULL;
+}
+
+int device_start(m8_device_s *device, int index, struct sp_port *port,
+                 int (*recv_message)(uint8_t *data, uint32_t size)) {
+  device->index = index;
+  device->port = port;
+  device->queued = 0;
+  device->failed = 0;
+  device->running = 1;
+  device->started = 0;
+
+  device->slip_descriptor = (slip_descriptor_s){
+      .buf = device->slip_buffer,
+      .buf_size = sizeof(device->slip_buffer),
+      .recv_message = recv_message,
+  };
+  slip_init(&device->slip, &device->slip_descriptor);
+
+  pthread_mutex_init(&device->lock, NULL);
+  if (pthread_create(&device->thread, NULL, device_threadproc, device) != 0) {
+    SDL_LogError(SDL_LOG_CATEGORY_SYSTEM, "Device %d: cannot start thread",
+                 index);
+    pthread_mutex_destroy(&device->lock);
+    device->running = 0;
+    return -1;
+  }
+
+  device->started = 1;
+  return 1;
+}
+
+// Takes up to size bytes from the queue. Returns the number of bytes, or -1
+// when reading the port has failed and everything queued has been taken.
+int device_read(m8_device_s *device, uint8_t *buf, int size) {
+  pthread_mutex_lock(&device->lock);
+  int count = device->queued < size ? device->queued : size;
+  memcpy(buf, device->queue, count);
+  device->queued -= count;
+  memmove(device->queue, &device->queue[count], device->queued);
+  int failed = device->failed;
+  pthread_mutex_unlock(&device->lock);
+
+  if (count == 0 && failed)
+    return -1;
+
+  return count;
+}
+
+void device_stop(m8_device_s *device) {
+  if (!device->started)
+    return;
+
+  device->started = 0;
+  device->running = 0;
+  pthread_join(device->thread, NULL);
+  pthread_mutex_destroy(&device->lock);
+}
@@ -0,0 +1,37 @@
+#ifndef DEVICE_H_
+#define DEVICE_H_
+
+#include <libserialport.h>
+#include <pthread.h>
+#include <stdint.h>
+
+#include "slip.h"
+
+#define max_devices 8
+#define device_queue_size 65536
+
+// An M8 driven together with others. Its serial port is read by a thread of
+// its own and the data is queued for the main thread, which decodes it.
+typedef struct m8_device_s {
+  int index;
+  struct sp_port *port;
+
+  slip_descriptor_s slip_descriptor;
+  slip_handler_s slip;
+  uint8_t slip_buffer[1024];
+
+  pthread_t thread;
+  int started;
+  pthread_mutex_t lock;
+  uint8_t queue[device_queue_size];
+  int queued;
+  volatile int running;
+  int failed; // protected by lock
+} m8_device_s;
+
+int device_start(m8_device_s *device, int index, struct sp_port *port,
+                 int (*recv_message)(uint8_t *data, uint32_t size));
+int device_read(m8_device_s *device, uint8_t *buf, int size);
+void device_stop(m8_device_s *device);
+
+#endif
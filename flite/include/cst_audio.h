@@ -119,5 +119,9 @@ typedef int (*cst_audio_stream_callback)(const cst_wave *w,int start,int size,
 /* An example audio streaming callback function src/audio/au_streaming.c */
 int audio_stream_chunk(const cst_wave *w, int start, int size, 
                        int last, cst_audio_streaming_info *asi);
+/* Streams into the cst_wave_stream in asi->userdata, for synthesizing */
+/* straight to a riff file, the caller closes it once done            */
+int audio_stream_chunk_wave(const cst_wave *w, int start, int size, 
+                            int last, cst_audio_streaming_info *asi);
 
 #endif
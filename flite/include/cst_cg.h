@@ -151,6 +151,11 @@ typedef struct cst_cg_db_struct {
 
     int freeable;  /* doesn't get dumped, but 1 when this a freeable struct */
 
+    /* Model vectors dequantized as they are first used, up to the bytes */
+    /* allowed by the "cg_expand_budget" feature.  Not dumped.          */
+    float ***expanded_vectors;
+    long expanded_bytes;
+
 } cst_cg_db;
 
 CST_VAL_USER_TYPE_DCLS(cg_db,cst_cg_db)
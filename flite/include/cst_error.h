@@ -64,7 +64,15 @@ void longjmp(register jmp_buf env, register int value);
 #endif
 #else /* not palmos */
 #include <setjmp.h>
-extern jmp_buf *cst_errjmp;
+/* Each thread sets its own catch, so several can synthesize at once */
+#if defined(__GNUC__) || defined(__clang__)
+#define CST_THREAD_LOCAL __thread
+#elif defined(_MSC_VER)
+#define CST_THREAD_LOCAL __declspec(thread)
+#else
+#define CST_THREAD_LOCAL
+#endif
+extern CST_THREAD_LOCAL jmp_buf *cst_errjmp;
 # define cst_error() (cst_errjmp ? longjmp(*cst_errjmp,1) : exit(-1))
 #endif
 
@@ -44,10 +44,19 @@
 #include "cst_val.h"
 #include "cst_string.h"
 
+/* Feature names are interned as symbols, one per distinct name, so */
+/* features can be found by comparing pointers rather than strings   */
+typedef struct cst_feat_sym_struct {
+    const char *name;
+    unsigned int hash;
+    struct cst_feat_sym_struct *next;
+} cst_feat_sym;
+
 typedef struct cst_featvalpair_struct {
     const char *name;
     cst_val *val;
     struct cst_featvalpair_struct *next;
+    const cst_feat_sym *sym;
 } cst_featvalpair;
 
 typedef struct cst_features_struct {
@@ -57,6 +66,11 @@ typedef struct cst_features_struct {
 
     /* Link to other cst_features that we search too */
     const struct cst_features_struct *linked; 
+
+    /* Hash table over the list above, once it's more than a few long */
+    cst_featvalpair **table;
+    int table_size;
+    int count;
 } cst_features;
 
 /* Constructor functions */
@@ -81,6 +95,13 @@ void feat_set_float(cst_features *f, const char *name, float v);
 void feat_set_string(cst_features *f, const char *name, const char *v);
 void feat_set(cst_features *f, const char *name,const cst_val *v);
 
+/* Symbol versions of the above, for callers that look up the same */
+/* names many times                                                  */
+const cst_feat_sym *feat_intern(const char *name);
+const cst_feat_sym *feat_sym(const char *name); /* NULL if never interned */
+const cst_val *feat_val_sym(const cst_features *f, const cst_feat_sym *s);
+void feat_set_sym(cst_features *f, const cst_feat_sym *s, const cst_val *v);
+
 int feat_remove(cst_features *f,const char *name);
 int feat_present(const cst_features *f,const char *name);
 int feat_length(const cst_features *f);
@@ -113,6 +113,12 @@ void delete_cst_regex(cst_regex *r);
 int cst_regex_match(const cst_regex *r, const char *str);
 cst_regstate *cst_regex_match_return(const cst_regex *r, const char *str);
 
+/* Regexes compiled to DFAs, NULL if the regex can't be */
+typedef struct cst_regex_dfa_struct cst_regex_dfa;
+cst_regex_dfa *cst_regex_dfa_compile(const cst_regex *r);
+void cst_regex_dfa_delete(cst_regex_dfa *d);
+int cst_regex_dfa_match(const cst_regex_dfa *d, const char *str);
+
 /* Internal functions from original HS code */
 cst_regex *hs_regcomp(const char *);
 cst_regstate *hs_regexec(const cst_regex *, const char *);
@@ -131,9 +131,17 @@ const cst_val *set_car(cst_val *v1, const cst_val *v2);
 
 int cst_val_consp(const cst_val *v);
 
+/* Ints, and floats where they fit, are held in the cst_val pointer   */
+/* itself rather than in an allocated cell.  Cells are at least 4 byte */
+/* aligned, so an odd pointer is such an immediate, and its bottom two */
+/* bits are its type, CST_VAL_TYPE_INT or CST_VAL_TYPE_FLOAT           */
+#define CST_VAL_IMMEDIATE(X) (((uintptr_t)(X)) & 1)
+
 /* Unsafe accessor function -- for the brave and foolish */
 #define CST_VAL_STRING_LVAL(X) ((X)->c.a.v.vval)
-#define CST_VAL_TYPE(X) ((X)->c.a.type)
+#define CST_VAL_TYPE(X) \
+    (CST_VAL_IMMEDIATE(X) ? (int)(((uintptr_t)(X)) & 3) : (X)->c.a.type)
+#define CST_VAL_CELL_TYPE(X) ((X)->c.a.type)
 #define CST_VAL_INT(X) ((X)->c.a.v.ival)
 #define CST_VAL_FLOAT(X) ((X)->c.a.v.fval)
 #define CST_VAL_STRING(X) ((const char *)(CST_VAL_STRING_LVAL(X)))
@@ -92,6 +92,23 @@ int cst_wave_append_riff(cst_wave *w,const char *filename);
 int cst_wave_save_riff_fd(cst_wave *w, cst_file fd);
 int cst_wave_save_raw_fd(cst_wave *w, cst_file fd);
 
+/* A riff file written a piece at a time, "-" is stdout */
+typedef struct cst_wave_stream_struct {
+    cst_file fd;
+    int sample_rate;
+    int num_channels;
+    int num_samples;     /* written so far, over all channels */
+    int seekable;        /* else the header sizes stay unknown */
+    long header_offset;  /* where the header starts in fd */
+    int header_written;
+    int is_stdout;
+} cst_wave_stream;
+
+cst_wave_stream *cst_wave_stream_open(const char *filename);
+int cst_wave_stream_write(cst_wave_stream *s, const cst_wave *w,
+                          int start, int size);
+int cst_wave_stream_close(cst_wave_stream *s);
+
 int cst_wave_load(cst_wave *w, const char *filename, const char *type);
 int cst_wave_load_riff(cst_wave *w, const char *filename);
 int cst_wave_load_raw(cst_wave *w, const char *filename,
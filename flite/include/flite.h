@@ -104,6 +104,9 @@ cst_wave *flite_text_to_wave(const char *text,cst_voice *voice);
 cst_utterance *flite_synth_text(const char *text,cst_voice *voice);
 cst_utterance *flite_synth_phones(const char *phones,cst_voice *voice);
 
+/* With the voice feature "synth_threads" above 1, utterances are      */
+/* synthesized by that many threads and output in order, except when   */
+/* the outtype is "stream"                                             */
 float flite_ts_to_speech(cst_tokenstream *ts, 
                          cst_voice *voice,
                          const char *outtype);
@@ -114,6 +117,21 @@ float flite_process_output(cst_utterance *u,
                            const char *outtype,
                            int append);
 
+/* A synthesis context: parameters set in its features override the  */
+/* voice's for the syntheses done through it, so threads can share a  */
+/* voice, which is only read during synthesis, and each use their own */
+/* context.  A context itself should only be used by one thread at a  */
+/* time.                                                              */
+typedef struct flite_context_struct {
+    cst_voice *voice;
+    cst_features *features;
+} flite_context;
+
+flite_context *new_flite_context(cst_voice *voice);
+void delete_flite_context(flite_context *c);
+cst_utterance *flite_context_synth_text(flite_context *c, const char *text);
+cst_wave *flite_context_text_to_wave(flite_context *c, const char *text);
+
 /* for voices with external voxdata */
 int flite_mmap_clunit_voxdata(const char *voxdir, cst_voice *voice);
 int flite_munmap_clunit_voxdata(cst_voice *voice);
@@ -136,7 +154,8 @@ const cst_val *flite_ffeature(const cst_item *item,const char *featpath);
 cst_item* flite_path_to_item(const cst_item *item,const char *featpath);
 
 /* These functions are *not* thread-safe, they are designed to be called */
-/* before the initial synthesis occurs */
+/* before the initial synthesis occurs, as are flite_voice_select() and */
+/* flite_voice_load() */
 int flite_add_voice(cst_voice *voice);
 int flite_add_lang(const char *langname,
                    void (*lang_init)(cst_voice *vox),
@@ -10,37 +10,45 @@
 
 #include <portaudio.h>
 
-int initialized = 0;
-PaStreamParameters outputParameters;
-PaStream* stream = NULL;
+/* Each device keeps its own stream, so several threads can play at once */
+typedef struct au_portaudio_struct {
+    PaStreamParameters outputParameters;
+    PaStream* stream;
+} au_portaudio;
+
+static void stop_stream(au_portaudio *pd)
+{
+    if(pd->stream != NULL)
+    {
+        Pa_StopStream(pd->stream);
+        Pa_CloseStream(pd->stream);
+        pd->stream = NULL;
+    }
+}
 
 cst_audiodev *audio_open_portaudio(unsigned int sps, int channels, cst_audiofmt fmt)
 {
-    // Initialize PortAudio if not yet initialized
-    if(! initialized)
+    // Pa_Initialize() is reference counted, and matched in audio_close
+    if(Pa_Initialize() != paNoError)
     {
-        Pa_Initialize();
-
-        outputParameters.device = Pa_GetDefaultOutputDevice();
-        if (outputParameters.device == paNoDevice){
-            fprintf(stderr,"Error: Could not find output device.\n");
-            return NULL;
-        }
-
-        outputParameters.channelCount = channels;
-        outputParameters.sampleFormat = paInt16;
-        outputParameters.suggestedLatency = Pa_GetDeviceInfo( outputParameters.device )->defaultLowOutputLatency;
-        outputParameters.hostApiSpecificStreamInfo = NULL;
-        initialized = 1;
+        fprintf(stderr,"Error: Could not initialize PortAudio.\n");
+        return NULL;
     }
 
-    // Stop any ongoing streams
-	if(stream != NULL)
-	{
-        Pa_StopStream(stream);
-        Pa_CloseStream(stream);
-		stream = NULL;
-	}
+    au_portaudio *pd = cst_alloc(au_portaudio, 1);
+    pd->stream = NULL;
+    pd->outputParameters.device = Pa_GetDefaultOutputDevice();
+    if (pd->outputParameters.device == paNoDevice){
+        fprintf(stderr,"Error: Could not find output device.\n");
+        cst_free(pd);
+        Pa_Terminate();
+        return NULL;
+    }
+
+    pd->outputParameters.channelCount = channels;
+    pd->outputParameters.sampleFormat = paInt16;
+    pd->outputParameters.suggestedLatency = Pa_GetDeviceInfo( pd->outputParameters.device )->defaultLowOutputLatency;
+    pd->outputParameters.hostApiSpecificStreamInfo = NULL;
 
     /* Write hardware parameters to flite audio device data structure */
     cst_audiodev *ad = cst_alloc(cst_audiodev, 1);
@@ -49,54 +57,50 @@ cst_audiodev *audio_open_portaudio(unsigned int sps, int channels, cst_audiofmt
     ad->real_sps = ad->sps = sps;
     ad->real_channels = ad->channels = channels;
     ad->real_fmt = ad->fmt = fmt;
-    ad->platform_data = NULL;
+    ad->platform_data = pd;
 
     return ad;
 }
 
 int audio_close_portaudio(cst_audiodev *ad)
 {
-    cst_free(ad);
+    au_portaudio *pd = ad->platform_data;
 
-	if(stream != NULL)
-	{
-        Pa_StopStream(stream);
-        Pa_CloseStream(stream);
-		stream = NULL;
-	}
+    stop_stream(pd);
+    cst_free(pd);
+    cst_free(ad);
+    Pa_Terminate();
 
     return 1;
 }
 
 int audio_write_portaudio(cst_audiodev *ad, void *samples, int num_bytes)
 {
+    au_portaudio *pd = ad->platform_data;
     size_t frame_size  = audio_bps(ad->real_fmt) * ad->real_channels;
     ssize_t num_frames = num_bytes / frame_size;
-    printf("Num frames: %ld\n", num_frames);
     
-    PaError result = Pa_OpenStream(&stream, NULL, &outputParameters, ad->sps, num_frames, paClipOff, NULL, NULL);
+    PaError result = Pa_OpenStream(&pd->stream, NULL, &pd->outputParameters, ad->sps, num_frames, paClipOff, NULL, NULL);
     if(result != paNoError)
     {
-        fprintf(stderr,"Here2.\n");
         printf("Could not initialize stream: %s\n", Pa_GetErrorText(result));
+        pd->stream = NULL;
+        return 0;
     }
 
-    result = Pa_StartStream(stream);
+    result = Pa_StartStream(pd->stream);
     if(result != paNoError)
     {
-        fprintf(stderr,"Here5.\n");
         printf("Could not start stream: %s\n", Pa_GetErrorText(result));
     }
 
-    result = Pa_WriteStream(stream, samples, num_frames);
+    result = Pa_WriteStream(pd->stream, samples, num_frames);
     if(result != paNoError)
     {
-        fprintf(stderr,"Here7.\n");
         printf("Could not output audio: %s\n", Pa_GetErrorText(result));
     }
 
-    Pa_StopStream(stream);
-    Pa_CloseStream(stream);
+    stop_stream(pd);
 
     return num_bytes;
 }
@@ -92,3 +92,17 @@ int audio_stream_chunk(const cst_wave *w, int start, int size,
     return CST_AUDIO_STREAM_CONT;
 }
 
+int audio_stream_chunk_wave(const cst_wave *w, int start, int size, 
+                            int last, cst_audio_streaming_info *asi)
+{
+    /* Writes the samples out as they are made, the stream stays open */
+    /* over utterances so a whole text ends up in one file            */
+    cst_wave_stream *ws = (cst_wave_stream *)asi->userdata;
+
+    if (ws == NULL)
+        return CST_AUDIO_STREAM_STOP;
+    if (cst_wave_stream_write(ws,w,start,size) != 0)
+        return CST_AUDIO_STREAM_STOP;
+
+    return CST_AUDIO_STREAM_CONT;
+}
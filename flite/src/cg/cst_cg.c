@@ -123,6 +123,17 @@ void delete_cg_db(cst_cg_db *db)
     }
     cst_free((void *)db->qtable);
 
+    if (db->expanded_vectors)
+    {
+        for (j = 0; j<db->num_param_models; j++)
+        {
+            for (i=0; db->expanded_vectors[j] && i<db->num_frames[j]; i++)
+                cst_free(db->expanded_vectors[j][i]);
+            cst_free(db->expanded_vectors[j]);
+        }
+        cst_free(db->expanded_vectors);
+    }
+
     /* Moved to here so they can be used for the model_shape freeing */
     cst_free(db->num_channels);
     cst_free(db->num_frames);
@@ -593,6 +604,69 @@ static int unpack_model_vector(cst_cg_db *cg_db,int pm,int f,float *v)
     }
 }
 
+#if defined(__GNUC__) || defined(__clang__)
+/* Several threads may be synthesizing with this db, so the expanded */
+/* vectors are published with a compare and swap, and a thread that  */
+/* loses the race frees its copy                                     */
+static void *cg_publish(void *slot, void *p)
+{
+    void *expected = NULL;
+
+    if (__atomic_compare_exchange_n((void **)slot,&expected,p,0,
+                                    __ATOMIC_ACQ_REL,__ATOMIC_ACQUIRE))
+        return p;
+    cst_free(p);
+    return expected;
+}
+
+static const float *expanded_model_vector(cst_cg_db *cg_db,int pm,int f,
+                                          float *scratch,long budget)
+{
+    /* Returns the dequantized model vector, from the expanded vectors */
+    /* if it has been used before, else keeping it if the budget allows */
+    float ***models, **frames, *v;
+    long size;
+
+    if (budget <= 0)
+    {
+        unpack_model_vector(cg_db,pm,f,scratch);
+        return scratch;
+    }
+
+    models = __atomic_load_n(&cg_db->expanded_vectors,__ATOMIC_ACQUIRE);
+    if (models == NULL)
+        models = cg_publish(&cg_db->expanded_vectors,
+                            cst_alloc(float **,cg_db->num_param_models));
+    frames = __atomic_load_n(&models[pm],__ATOMIC_ACQUIRE);
+    if (frames == NULL)
+        frames = cg_publish(&models[pm],
+                            cst_alloc(float *,cg_db->num_frames[pm]));
+    v = __atomic_load_n(&frames[f],__ATOMIC_ACQUIRE);
+    if (v)
+        return v;
+
+    size = sizeof(float)*cg_db->num_channels[0];
+    if (__atomic_add_fetch(&cg_db->expanded_bytes,size,__ATOMIC_RELAXED) >
+        budget)
+    {
+        __atomic_sub_fetch(&cg_db->expanded_bytes,size,__ATOMIC_RELAXED);
+        unpack_model_vector(cg_db,pm,f,scratch);
+        return scratch;
+    }
+
+    v = cst_alloc(float,cg_db->num_channels[0]);
+    unpack_model_vector(cg_db,pm,f,v);
+    return cg_publish(&frames[f],v);
+}
+#else
+static const float *expanded_model_vector(cst_cg_db *cg_db,int pm,int f,
+                                          float *scratch,long budget)
+{
+    unpack_model_vector(cg_db,pm,f,scratch);
+    return scratch;
+}
+#endif
+
 static cst_utterance *cg_predict_params(cst_utterance *utt)
 {
     cst_cg_db *cg_db;
@@ -602,7 +676,9 @@ static cst_utterance *cg_predict_params(cst_utterance *utt)
     const cst_cart *mcep_tree, *f0_tree;
     int i,j,f,p,o,pm;
     const char *mname;
-    float *unpacked_vector;
+    float *scratch_vector;
+    const float *unpacked_vector;
+    long expand_budget;
     float f0_val, f0_bit;
     float local_gain, voicing;
     int fff;
@@ -629,7 +705,8 @@ static cst_utterance *cg_predict_params(cst_utterance *utt)
                      utt_feat_int(utt,"param_track_num_frames"),
                      (cg_db->num_channels[0]/fff)-
                        (2 * extra_feats));/* no voicing or str */
-    unpacked_vector = cst_alloc(float,cg_db->num_channels[0]);
+    scratch_vector = cst_alloc(float,cg_db->num_channels[0]);
+    expand_budget = get_param_int(utt->features,"cg_expand_budget",0);
     f = 0;
     for (i=0,mcep=utt_rel_head(utt,"mcep"); mcep; i++,mcep=item_next(mcep))
     {
@@ -668,7 +745,9 @@ static cst_utterance *cg_predict_params(cst_utterance *utt)
             /* printf("awb_debug name %s i %d f %d\n",mname,i,f); */
 
             /* Unpack the model[pm][f] vector */
-            unpack_model_vector(cg_db,pm,f,unpacked_vector);
+            unpacked_vector = expanded_model_vector(cg_db,pm,f,
+                                                    scratch_vector,
+                                                    expand_budget);
 
             /* Old code used to average in param[0] with F0 too (???) */
 
@@ -704,7 +783,7 @@ static cst_utterance *cg_predict_params(cst_utterance *utt)
         param_track->times[i] = i * cg_db->frame_advance;
     }
 
-    cst_free(unpacked_vector);
+    cst_free(scratch_vector);
     cg_smooth_F0(utt,cg_db,param_track);
 
     utt_set_feat(utt,"param_track",track_val(param_track));
@@ -714,6 +793,28 @@ static cst_utterance *cg_predict_params(cst_utterance *utt)
     return utt;
 }
 
+static cst_track *cg_static_means(const cst_track *param_track)
+{
+    /* The track mlpg() would return, without the smoothing: the static */
+    /* means that mlpg() starts from                                    */
+    cst_track *out;
+    int i,j,dim_st;
+
+    dim_st = ((param_track->num_channels/2)-1)/2;
+    out = new_track();
+    cst_track_resize(out,param_track->num_frames,dim_st+1);
+
+    for (i=0; i<param_track->num_frames; i++)
+    {
+        out->times[i] = param_track->times[i];
+        out->frames[i][0] = param_track->frames[i][0]; /* F0 */
+        for (j=0; j<dim_st; j++)
+            out->frames[i][j+1] = param_track->frames[i][(j+1)*2];
+    }
+
+    return out;
+}
+
 static cst_utterance *cg_resynth(cst_utterance *utt)
 {
     cst_cg_db *cg_db;
@@ -724,6 +825,7 @@ static cst_utterance *cg_resynth(cst_utterance *utt)
     const cst_val *streaming_info_val;
     cst_audio_streaming_info *asi = NULL;
     int mlsa_speed_param = 0;
+    int mlpg_skip_frames;
 
     streaming_info_val=get_param_val(utt->features,"streaming_info",NULL);
     if (streaming_info_val)
@@ -744,7 +846,17 @@ static cst_utterance *cg_resynth(cst_utterance *utt)
     if (cg_db->mixed_excitation)
         str_track = val_track(utt_feat_val(utt,"str_track"));
 
-    if (cg_db->do_mlpg)
+    /* Short utterances may be allowed to skip MLPG to save time */
+    mlpg_skip_frames = get_param_int(utt->features,"mlpg_skip_frames",0);
+
+    if (cg_db->do_mlpg && (param_track->num_frames < mlpg_skip_frames))
+    {
+        smoothed_track = cg_static_means(param_track);
+        w = mlsa_resynthesis(smoothed_track,str_track,cg_db,
+                             asi,mlsa_speed_param);
+        delete_track(smoothed_track);
+    }
+    else if (cg_db->do_mlpg)
     {
         smoothed_track = mlpg(param_track, cg_db);
         /* cst_track_save_est(smoothed_track, "flite_post_mlpg.track"); */
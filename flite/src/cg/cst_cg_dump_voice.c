@@ -82,6 +82,7 @@ static void cst_cg_write_tree_nodes(cst_file fd, const cst_cart_node* nodes)
     int num_nodes, i;
     int an_int;
     float a_float;
+    short a_type;
 
     num_nodes=0;
     while(nodes[num_nodes].val != 0)
@@ -93,20 +94,21 @@ static void cst_cg_write_tree_nodes(cst_file fd, const cst_cart_node* nodes)
 	cst_fwrite(fd, &nodes[i].feat,sizeof(char),1);
 	cst_fwrite(fd, &nodes[i].op,sizeof(char),1);
 	cst_fwrite(fd, &nodes[i].no_node,sizeof(short),1);
-        cst_fwrite(fd, &nodes[i].val->c.a.type,sizeof(short),1);
-        if (nodes[i].val->c.a.type == CST_VAL_TYPE_STRING)
+        a_type = CST_VAL_TYPE(nodes[i].val);
+        cst_fwrite(fd, &a_type,sizeof(short),1);
+        if (a_type == CST_VAL_TYPE_STRING)
         {
-            cst_cg_write_padded(fd, nodes[i].val->c.a.v.vval, 
-                                cst_strlen(nodes[i].val->c.a.v.vval)+1);
+            cst_cg_write_padded(fd, val_string(nodes[i].val), 
+                                cst_strlen(val_string(nodes[i].val))+1);
         }
-        else if (nodes[i].val->c.a.type == CST_VAL_TYPE_INT)
+        else if (a_type == CST_VAL_TYPE_INT)
         {
-            an_int=nodes[i].val->c.a.v.ival;
+            an_int=val_int(nodes[i].val);
             cst_fwrite(fd, &an_int,sizeof(int),1);
         }
-        else if (nodes[i].val->c.a.type == CST_VAL_TYPE_FLOAT)
+        else if (a_type == CST_VAL_TYPE_FLOAT)
         {
-            a_float=nodes[i].val->c.a.v.fval;
+            a_float=val_float(nodes[i].val);
             cst_fwrite(fd, &a_float,sizeof(float),1);
         }
         else
@@ -73,6 +73,29 @@
 #define double float
 #endif
 
+/* The vocoder normally runs in double precision.  Build with         */
+/* CST_CG_FLOAT to run it in single precision, for CPUs with slow       */
+/* doubles, or with CST_CG_FIXED to also run the MLSA filter itself in  */
+/* fixed point, for CPUs without an FPU                                  */
+#if defined(CST_CG_FLOAT) || defined(CST_CG_FIXED)
+typedef float mlsa_real;
+#define mlsa_exp expf
+#define mlsa_log logf
+#define mlsa_sqrt sqrtf
+#ifdef CST_CG_FIXED
+#include <stdint.h>
+#define MLSA_QS 8   /* samples and filter state */
+#define MLSA_QC 24  /* filter coefficients */
+#define mlsa_fix(X,Q) ((int)((X)*(float)(1<<(Q))+(((X)<0)?-0.5f:0.5f)))
+#define mlsa_mulq(C,X) ((int)(((int64_t)(C)*(X))>>MLSA_QC))
+#endif
+#else
+typedef double mlsa_real;
+#define mlsa_exp exp
+#define mlsa_log log
+#define mlsa_sqrt sqrt
+#endif
+
 #include "cst_vc.h"
 #include "cst_cg.h"
 #include "cst_mlsa.h"
@@ -116,14 +139,14 @@ static cst_wave *synthesis_body(const cst_track *params, /* f0 + mcep */
 {
     long t, pos;
     int framel, i;
-    double f0;
+    mlsa_real f0;
     VocoderSetup vs;
     cst_wave *wave = 0;
-    double *mcep;
+    mlsa_real *mcep;
     int stream_mark;
     int rc = CST_AUDIO_STREAM_CONT;
     int num_mcep;
-    double ffs = fs;
+    mlsa_real ffs = fs;
 
     num_mcep = params->num_channels-1;
     if ((num_mcep > mlsa_speed_param) &&
@@ -142,13 +165,13 @@ static cst_wave *synthesis_body(const cst_track *params, /* f0 + mcep */
     cst_wave_resize(wave,params->num_frames * framel,1);
     wave->sample_rate = fs; 
 
-    mcep = cst_alloc(double,num_mcep+1);
+    mcep = cst_alloc(mlsa_real,num_mcep+1);
 
     for (t = 0, stream_mark = pos = 0; 
          (rc == CST_AUDIO_STREAM_CONT) && (t < params->num_frames);
          t++) 
     {
-        f0 = (double)params->frames[t][0];
+        f0 = (mlsa_real)params->frames[t][0];
         for (i=1; i<num_mcep+1; i++)
             mcep[i-1] = params->frames[t][i];
         mcep[i-1] = 0;
@@ -184,9 +207,13 @@ static cst_wave *synthesis_body(const cst_track *params, /* f0 + mcep */
         return wave;
 }
 
-static void init_vocoder(double fs, int framel, int m, 
+static void init_vocoder(mlsa_real fs, int framel, int m, 
                          VocoderSetup *vs, cst_cg_db *cg_db)
 {
+#ifdef CST_CG_FIXED
+    int i;
+#endif
+
     /* initialize global parameter */
     vs->fprd = framel;
     vs->iprd = 1;
@@ -211,7 +238,7 @@ static void init_vocoder(double fs, int framel, int m,
     vs->pade[20]=0.00003041721;
 
     vs->rate = fs;
-    vs->c = cst_alloc(double,3 * (m + 1) + 3 * (vs->pd + 1) + vs->pd * (m + 2));
+    vs->c = cst_alloc(mlsa_real,3 * (m + 1) + 3 * (vs->pd + 1) + vs->pd * (m + 2));
    
     vs->p1 = -1;
     vs->sw = 0;
@@ -226,34 +253,44 @@ static void init_vocoder(double fs, int framel, int m,
     /* for MIXED EXCITATION */
     vs->ME_order = cg_db->ME_order;
     vs->ME_num = cg_db->ME_num;
-    vs->hpulse = cst_alloc(double,vs->ME_order);
-    vs->hnoise = cst_alloc(double,vs->ME_order);
-    vs->xpulsesig = cst_alloc(double,vs->ME_order);
-    vs->xnoisesig = cst_alloc(double,vs->ME_order);
+    vs->hpulse = cst_alloc(mlsa_real,vs->ME_order);
+    vs->hnoise = cst_alloc(mlsa_real,vs->ME_order);
+    vs->xpulsesig = cst_alloc(mlsa_real,vs->ME_order);
+    vs->xnoisesig = cst_alloc(mlsa_real,vs->ME_order);
     vs->h = cg_db->me_h;
 
+#ifdef CST_CG_FIXED
+    vs->cq = cst_alloc(int,2 * (m + 1));
+    vs->cincq = vs->cq + m + 1;
+    vs->dq = cst_alloc(int,3 * (vs->pd + 1) + vs->pd * (m + 2));
+    for (i=0; i<21; i++)
+        vs->padeq[i] = mlsa_fix(vs->pade[i],MLSA_QC);
+    vs->aq = mlsa_fix(cg_db->mlsa_alpha,MLSA_QC);
+    vs->aaq = mlsa_fix(1 - cg_db->mlsa_alpha*cg_db->mlsa_alpha,MLSA_QC);
+#endif
+
     return;
 }
 
-static double plus_or_minus_one()
+static mlsa_real plus_or_minus_one()
 {
     /* Randomly return 1 or -1 */
     /* not sure rand() is portable */
-    if (rand() > RAND_MAX/2.0)
+    if (rand() > RAND_MAX/2)
         return 1.0;
     else
         return -1.0;
 }
 
-static void vocoder(double p, double *mc, 
+static void vocoder(mlsa_real p, mlsa_real *mc, 
                     const float *str,
                     int m, cst_cg_db *cg_db,
                     VocoderSetup *vs, cst_wave *wav, long *pos)
 {
-    double inc, x, e1, e2;
+    mlsa_real inc, x, e1, e2;
     int i, j, k; 
-    double xpulse, xnoise;
-    double fxpulse, fxnoise;
+    mlsa_real xpulse, xnoise;
+    mlsa_real fxpulse, fxnoise;
     float gain=1.0;
 
     if (cg_db->gain != 0.0)
@@ -294,7 +331,7 @@ static void vocoder(double p, double *mc,
 	    for (k=2;k<=m;k++)
 		vs->c[k] *= (1.0 + cg_db->mlsa_beta);
 	    e2 = b2en(vs->c, m, cg_db->mlsa_alpha, vs);
-	    vs->c[0] += log(e1/e2)/2;
+	    vs->c[0] += mlsa_log(e1/e2)/2;
 	}
 
 	return;
@@ -308,15 +345,26 @@ static void vocoder(double p, double *mc,
 	for (k = 2; k <= m; k++)
 	    vs->cc[k] *= (1.0 + cg_db->mlsa_beta);
 	e2 = b2en(vs->cc, m, cg_db->mlsa_alpha, vs);
-	vs->cc[0] += log(e1 / e2) / 2.0;
+	vs->cc[0] += mlsa_log(e1 / e2) / 2.0;
     }
 
     for (k=0; k<=m; k++)
 	vs->cinc[k] = (vs->cc[k] - vs->c[k]) *
-	    (double)vs->iprd / (double)vs->fprd;
+	    (mlsa_real)vs->iprd / (mlsa_real)vs->fprd;
+
+#ifdef CST_CG_FIXED
+    for (k=0; k<=m; k++)
+    {
+        vs->cq[k] = mlsa_fix(vs->c[k],MLSA_QC);
+        vs->cincq[k] = mlsa_fix(vs->cinc[k],MLSA_QC);
+    }
+    vs->xgain = mlsa_exp(vs->c[0]) * 
+        ((cg_db->sample_rate == 8000) ? 2 : gain);
+    vs->xgain_inc = mlsa_exp(vs->cinc[0]);
+#endif
 
     if (vs->p1!=0.0 && p!=0.0) {
-	inc = (p - vs->p1) * (double)vs->iprd / (double)vs->fprd;
+	inc = (p - vs->p1) * (mlsa_real)vs->iprd / (mlsa_real)vs->fprd;
     } else {
 	inc = 0.0;
 	vs->pc = p;
@@ -326,7 +374,7 @@ static void vocoder(double p, double *mc,
     for (j = vs->fprd, i = (vs->iprd + 1) / 2; j--;) {
 	if (vs->p1 == 0.0) {
 	    if (vs->gauss)
-		x = (double) nrandom(vs);
+		x = (mlsa_real) nrandom(vs);
 	    else
 		x = plus_or_minus_one();
             if (str != NULL)             /* MIXED EXCITATION */
@@ -335,8 +383,8 @@ static void vocoder(double p, double *mc,
                 xpulse = 0.0;
             }
 	} else {
-	    if ((vs->pc += 1.0) >= vs->p1) {
-		x = sqrt (vs->p1);
+	    if ((vs->pc += 1) >= vs->p1) {
+		x = mlsa_sqrt(vs->p1);
 		vs->pc = vs->pc - vs->p1;
 	    } else 
                 x = 0.0;
@@ -369,11 +417,24 @@ static void vocoder(double p, double *mc,
             x = fxpulse + fxnoise; /* excitation is pulse plus noise */
         }
 
+#ifdef CST_CG_FIXED
+        wav->samples[*pos] =
+            (short)(mlsadf_fixed(mlsa_fix(x * vs->xgain,MLSA_QS), m, vs) >>
+                    MLSA_QS);
+	*pos += 1;
+
+	if (!--i) {
+	    vs->p1 += inc;
+	    for (k = 0; k <= m; k++) vs->cq[k] += vs->cincq[k];
+	    vs->xgain *= vs->xgain_inc;
+	    i = vs->iprd;
+	}
+#else
         if (cg_db->sample_rate == 8000)
             /* 8KHz voices are too quiet: this is probably not general */
-            x *= exp(vs->c[0])*2.0;
+            x *= mlsa_exp(vs->c[0])*2;
         else
-            x *= exp(vs->c[0])*gain;
+            x *= mlsa_exp(vs->c[0])*gain;
 
 	x = mlsadf(x, vs->c, m, cg_db->mlsa_alpha, vs->pd, vs->d1, vs);
 
@@ -385,15 +446,17 @@ static void vocoder(double p, double *mc,
 	    for (k = 0; k <= m; k++) vs->c[k] += vs->cinc[k];
 	    i = vs->iprd;
 	}
+#endif
     }
    
     vs->p1 = p;
-    memmove(vs->c,vs->cc,sizeof(double)*(m+1));
+    memmove(vs->c,vs->cc,sizeof(mlsa_real)*(m+1));
    
     return;
 }
 
-static double mlsadf(double x, double *b, int m, double a, int pd, double *d, VocoderSetup *vs)
+#ifndef CST_CG_FIXED
+static mlsa_real mlsadf(mlsa_real x, mlsa_real *b, int m, mlsa_real a, int pd, mlsa_real *d, VocoderSetup *vs)
 {
 
    vs->ppade = &(vs->pade[pd*(pd+1)/2]);
@@ -404,9 +467,9 @@ static double mlsadf(double x, double *b, int m, double a, int pd, double *d, Vo
    return(x);
 }
 
-static double mlsadf1(double x, double *b, int m, double a, int pd, double *d, VocoderSetup *vs)
+static mlsa_real mlsadf1(mlsa_real x, mlsa_real *b, int m, mlsa_real a, int pd, mlsa_real *d, VocoderSetup *vs)
 {
-   double v, out = 0.0, *pt, aa;
+   mlsa_real v, out = 0.0, *pt, aa;
    int i;
 
    aa = 1 - a*a;
@@ -426,9 +489,9 @@ static double mlsadf1(double x, double *b, int m, double a, int pd, double *d, V
    return(out);
 }
 
-static double mlsadf2 (double x, double *b, int m, double a, int pd, double *d, VocoderSetup *vs)
+static mlsa_real mlsadf2 (mlsa_real x, mlsa_real *b, int m, mlsa_real a, int pd, mlsa_real *d, VocoderSetup *vs)
 {
-  double v, out = 0.0, *pt;
+  mlsa_real v, out = 0.0, *pt;
   int i;
     
    pt = &d[pd * (m+2)];
@@ -448,10 +511,10 @@ static double mlsadf2 (double x, double *b, int m, double a, int pd, double *d,
    return(out);
 }
 
-static double mlsafir (double x, double *b, int m, double a, double *d)
+static mlsa_real mlsafir (mlsa_real x, mlsa_real *b, int m, mlsa_real a, mlsa_real *d)
 {  
-   double y = 0.0;
-   double aa;
+   mlsa_real y = 0.0;
+   mlsa_real aa;
    int i;
 
    aa = 1 - a*a;
@@ -469,17 +532,75 @@ static double mlsafir (double x, double *b, int m, double a, double *d)
    return(y);
 }
 
-static double nrandom (VocoderSetup *vs)
+#else
+/* The MLSA filter in fixed point: the same as mlsadf() and friends with */
+/* samples and filter state in Q8 and coefficients in Q24, multiplied in */
+/* 64 bits                                                               */
+static int mlsafir_fixed(int x, const int *b, int m, int a, int aa, int *d)
+{
+   int64_t y = 0;
+   int i;
+
+   d[0] = x;
+   d[1] = mlsa_mulq(aa,d[0]) + mlsa_mulq(a,d[1]);
+   for (i=2; i<= m; i++) {
+      d[i] = d[i] + mlsa_mulq(a,d[i+1]-d[i-1]);
+      y += (int64_t)d[i]*b[i];
+   }
+
+   for (i=m+1; i>1; i--) 
+      d[i] = d[i-1];
+
+   return (int)(y >> MLSA_QC);
+}
+
+static int mlsadf_fixed(int x, int m, VocoderSetup *vs)
+{
+   const int *ppade = &(vs->padeq[vs->pd*(vs->pd+1)/2]);
+   const int *b = vs->cq;
+   int pd = vs->pd;
+   int v, out, *d, *pt;
+   int i;
+
+   /* mlsadf1 */
+   d = vs->dq;
+   pt = &d[pd+1];
+   for (out=0, i=pd; i>=1; i--) {
+      d[i] = mlsa_mulq(vs->aaq,pt[i-1]) + mlsa_mulq(vs->aq,d[i]);
+      pt[i] = mlsa_mulq(b[1],d[i]);
+      v = mlsa_mulq(ppade[i],pt[i]);
+      x += (1 & i) ? v : -v;
+      out += v;
+   }
+   pt[0] = x;
+   x = out + x;
+
+   /* mlsadf2 */
+   d = &vs->dq[2*(pd+1)];
+   pt = &d[pd * (m+2)];
+   for (out=0, i=pd; i>=1; i--) {
+      pt[i] = mlsafir_fixed(pt[i-1], b, m, vs->aq, vs->aaq, &d[(i-1)*(m+2)]);
+      v = mlsa_mulq(ppade[i],pt[i]);
+      x += (1&i) ? v : -v;
+      out += v;
+   }
+   pt[0] = x;
+
+   return out + x;
+}
+#endif
+
+static mlsa_real nrandom (VocoderSetup *vs)
 {
    if (vs->sw == 0) {
       vs->sw = 1;
       do {
-         vs->r1 = 2.0 * rnd(&vs->next) - 1.0;
-         vs->r2 = 2.0 * rnd(&vs->next) - 1.0;
+         vs->r1 = 2 * rnd(&vs->next) - 1;
+         vs->r2 = 2 * rnd(&vs->next) - 1;
          vs->s  = vs->r1 * vs->r1 + vs->r2 * vs->r2;
       } while (vs->s > 1 || vs->s == 0);
 
-      vs->s = sqrt (-2 * log(vs->s) / vs->s);
+      vs->s = mlsa_sqrt(-2 * mlsa_log(vs->s) / vs->s);
       
       return(vs->r1*vs->s);
    }
@@ -490,9 +611,9 @@ static double nrandom (VocoderSetup *vs)
    }
 }
 
-static double rnd (unsigned long *next)
+static mlsa_real rnd (unsigned long *next)
 {
-   double r;
+   mlsa_real r;
 
    *next = *next * 1103515245L + 12345;
    r = (*next / 65536L) % 32768L;
@@ -506,7 +627,7 @@ static unsigned long srnd ( unsigned long seed )
 }
 
 /* mc2b : transform mel-cepstrum to MLSA digital fillter coefficients */
-static void mc2b (double *mc, double *b, int m, double a)
+static void mc2b (mlsa_real *mc, mlsa_real *b, int m, mlsa_real a)
 {
    b[m] = mc[m];
     
@@ -517,16 +638,16 @@ static void mc2b (double *mc, double *b, int m, double a)
 }
 
 
-static double b2en (double *b, int m, double a, VocoderSetup *vs)
+static mlsa_real b2en (mlsa_real *b, int m, mlsa_real a, VocoderSetup *vs)
 {
-   double en;
+   mlsa_real en;
    int k;
    
    if (vs->o<m) {
       if (vs->mc != NULL)
           cst_free(vs->mc);
     
-      vs->mc = cst_alloc(double,(m + 1) + 2 * vs->irleng);
+      vs->mc = cst_alloc(mlsa_real,(m + 1) + 2 * vs->irleng);
       vs->cep = vs->mc + m+1;
       vs->ir  = vs->cep + vs->irleng;
    }
@@ -544,9 +665,9 @@ static double b2en (double *b, int m, double a, VocoderSetup *vs)
 
 
 /* b2bc : transform MLSA digital filter coefficients to mel-cepstrum */
-static void b2mc (double *b, double *mc, int m, double a)
+static void b2mc (mlsa_real *b, mlsa_real *mc, int m, mlsa_real a)
 {
-  double d, o;
+  mlsa_real d, o;
         
   d = mc[m] = b[m];
   for (m--; m>=0; m--) {
@@ -559,21 +680,21 @@ static void b2mc (double *b, double *mc, int m, double a)
 }
 
 /* freqt : frequency transformation */
-static void freqt (double *c1, int m1, double *c2, int m2, double a, VocoderSetup *vs)
+static void freqt (mlsa_real *c1, int m1, mlsa_real *c2, int m2, mlsa_real a, VocoderSetup *vs)
 {
    int i, j;
-   double b;
+   mlsa_real b;
     
    if (vs->d==NULL) {
       vs->size = m2;
-      vs->d    = cst_alloc(double,vs->size + vs->size + 2);
+      vs->d    = cst_alloc(mlsa_real,vs->size + vs->size + 2);
       vs->g    = vs->d+vs->size+1;
    }
 
    if (m2>vs->size) {
        cst_free(vs->d);
       vs->size = m2;
-      vs->d    = cst_alloc(double,vs->size + vs->size + 2);
+      vs->d    = cst_alloc(mlsa_real,vs->size + vs->size + 2);
       vs->g    = vs->d+vs->size+1;
    }
     
@@ -590,18 +711,18 @@ static void freqt (double *c1, int m1, double *c2, int m2, double a, VocoderSetu
          vs->g[j] = vs->d[j-1]+a*((vs->d[j]=vs->g[j])-vs->g[j-1]);
    }
 
-   memmove(c2,vs->g,sizeof(double)*(m2+1));
+   memmove(c2,vs->g,sizeof(mlsa_real)*(m2+1));
    
    return;
 }
 
 /* c2ir : The minimum phase impulse response is evaluated from the minimum phase cepstrum */
-static void c2ir (double *c, int nc, double *h, int leng)
+static void c2ir (mlsa_real *c, int nc, mlsa_real *h, int leng)
 {
    int n, k, upl;
-   double  d;
+   mlsa_real  d;
 
-   h[0] = exp(c[0]);
+   h[0] = mlsa_exp(c[0]);
    for (n=1; n<leng; n++) {
       d = 0;
       upl = (n>=nc) ? nc-1 : n;
@@ -631,6 +752,11 @@ static void free_vocoder(VocoderSetup *vs)
     vs->cep = NULL;
     vs->ir = NULL;
 
+#ifdef CST_CG_FIXED
+    cst_free(vs->cq);
+    cst_free(vs->dq);
+#endif
+
     cst_free(vs->hpulse);
     cst_free(vs->hnoise);
     cst_free(vs->xpulsesig);
@@ -69,64 +69,79 @@ typedef struct _VocoderSetup {
    int pd;
    unsigned long next;
    Boolean gauss;
-   double p1;
-   double pc;
-   double pj;
-   double pade[21];
-   double *ppade;
-   double *c, *cc, *cinc, *d1;
-   double rate;
+   mlsa_real p1;
+   mlsa_real pc;
+   mlsa_real pj;
+   mlsa_real pade[21];
+   mlsa_real *ppade;
+   mlsa_real *c, *cc, *cinc, *d1;
+   mlsa_real rate;
    
    int sw;
-   double r1, r2, s;
+   mlsa_real r1, r2, s;
    
    int x;
    
    /* for postfiltering */
    int size;
-   double *d; 
-   double *g;
-   double *mc;
-   double *cep;
-   double *ir;
+   mlsa_real *d; 
+   mlsa_real *g;
+   mlsa_real *mc;
+   mlsa_real *cep;
+   mlsa_real *ir;
    int o;
    int irleng;
    
     /* for MIXED EXCITATION */
     int ME_order;
     int ME_num;
-    double *hpulse;
-    double *hnoise;
+    mlsa_real *hpulse;
+    mlsa_real *hnoise;
 
-    double *xpulsesig;
-    double *xnoisesig;
+    mlsa_real *xpulsesig;
+    mlsa_real *xnoisesig;
 
-    const double * const *h;  
+    const double * const *h;  /* the voice's, always double */  
+
+#ifdef CST_CG_FIXED
+    /* Fixed point copies for the MLSA filter */
+    int *cq, *cincq;        /* filter coefficients and their increments */
+    int *dq;                /* filter state */
+    int padeq[21];
+    int aq, aaq;            /* alpha and 1-alpha^2 */
+    mlsa_real xgain, xgain_inc; /* excitation gain, exp(c[0]) */
+#endif
 
 } VocoderSetup;
 
-static void init_vocoder(double fs, int framel, int m, 
+static void init_vocoder(mlsa_real fs, int framel, int m, 
                          VocoderSetup *vs, cst_cg_db *cg_db);
-static void vocoder(double p, double *mc, 
+static void vocoder(mlsa_real p, mlsa_real *mc, 
                     const float *str,
                     int m, cst_cg_db *cg_db,
                      VocoderSetup *vs, cst_wave *wav, long *pos);
-static double mlsadf(double x, double *b, int m, double a, int pd, double *d,
+#ifndef CST_CG_FIXED
+static mlsa_real mlsadf(mlsa_real x, mlsa_real *b, int m, mlsa_real a, int pd, mlsa_real *d,
 		     VocoderSetup *vs);
-static double mlsadf1(double x, double *b, int m, double a, int pd, double *d,
+static mlsa_real mlsadf1(mlsa_real x, mlsa_real *b, int m, mlsa_real a, int pd, mlsa_real *d,
 		      VocoderSetup *vs);
-static double mlsadf2(double x, double *b, int m, double a, int pd, double *d,
+static mlsa_real mlsadf2(mlsa_real x, mlsa_real *b, int m, mlsa_real a, int pd, mlsa_real *d,
 		      VocoderSetup *vs);
-static double mlsafir (double x, double *b, int m, double a, double *d);
-static double nrandom (VocoderSetup *vs);
-static double rnd (unsigned long *next);
+static mlsa_real mlsafir (mlsa_real x, mlsa_real *b, int m, mlsa_real a, mlsa_real *d);
+#endif
+static mlsa_real nrandom (VocoderSetup *vs);
+static mlsa_real rnd (unsigned long *next);
 static unsigned long srnd (unsigned long seed);
-static void mc2b (double *mc, double *b, int m, double a);
-static double b2en (double *b, int m, double a, VocoderSetup *vs);
-static void b2mc (double *b, double *mc, int m, double a);
-static void freqt (double *c1, int m1, double *c2, int m2, double a,
+static void mc2b (mlsa_real *mc, mlsa_real *b, int m, mlsa_real a);
+static mlsa_real b2en (mlsa_real *b, int m, mlsa_real a, VocoderSetup *vs);
+static void b2mc (mlsa_real *b, mlsa_real *mc, int m, mlsa_real a);
+static void freqt (mlsa_real *c1, int m1, mlsa_real *c2, int m2, mlsa_real a,
 		   VocoderSetup *vs);
-static void c2ir (double *c, int nc, double *h, int leng);
+static void c2ir (mlsa_real *c, int nc, mlsa_real *h, int leng);
+
+#ifdef CST_CG_FIXED
+static int mlsadf_fixed(int x, int m, VocoderSetup *vs);
+#endif
 
 static void free_vocoder(VocoderSetup *vs);
 
@@ -40,12 +40,96 @@
 
 #include "cst_features.h"
 #include "cst_lts.h"
-#include "cst_endian.h"
 
 static cst_lts_phone apply_model(cst_lts_letter *vals,
 				 cst_lts_addr start,
 				 const cst_lts_model *model);
 
+/* Words the models have been applied to, with the phones they gave, so  */
+/* words that keep coming back (as on a screen being read out) don't go  */
+/* through the models again.  Its a fixed number of entries, a new word  */
+/* replaces whatever was in its slot.  Rules are never deleted, so they  */
+/* can be part of the key                                                */
+#define CST_LTS_CACHE_SIZE 512
+
+typedef struct cst_lts_cache_entry_struct {
+    const cst_lts_rules *r;
+    unsigned int hash;
+    char *key;              /* word then feats, each nul terminated */
+    cst_lts_phone *phones;  /* as predicted, last letter first */
+    int num_phones;
+} cst_lts_cache_entry;
+
+static cst_lts_cache_entry lts_cache[CST_LTS_CACHE_SIZE];
+
+#if !defined(CST_NO_THREADS) && !defined(_WIN32) && !defined(UNDER_CE) && \
+    !defined(__palmos__)
+#include <pthread.h>
+static pthread_mutex_t lts_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+#define lts_cache_lock() pthread_mutex_lock(&lts_cache_lock)
+#define lts_cache_unlock() pthread_mutex_unlock(&lts_cache_lock)
+#else
+#define lts_cache_lock()
+#define lts_cache_unlock()
+#endif
+
+static unsigned int lts_hash(const cst_lts_rules *r, const char *word,
+                             const char *feats)
+{
+    unsigned int h = 2166136261u ^ (unsigned int)(size_t)r;
+
+    for ( ; *word; word++)
+        h = (h ^ (unsigned char)*word) * 16777619u;
+    for (h *= 16777619u; *feats; feats++)
+        h = (h ^ (unsigned char)*feats) * 16777619u;
+    return h;
+}
+
+static int lts_cache_lookup(const cst_lts_rules *r, unsigned int h,
+                            const char *word, const char *feats,
+                            cst_lts_phone *phones)
+{
+    cst_lts_cache_entry *e = &lts_cache[h % CST_LTS_CACHE_SIZE];
+    int n = -1;
+
+    lts_cache_lock();
+    if ((e->r == r) && (e->hash == h) && cst_streq(word,e->key) &&
+        cst_streq(feats,e->key+cst_strlen(e->key)+1))
+    {
+        n = e->num_phones;
+        memmove(phones,e->phones,n*sizeof(cst_lts_phone));
+    }
+    lts_cache_unlock();
+
+    return n;
+}
+
+static void lts_cache_add(const cst_lts_rules *r, unsigned int h,
+                          const char *word, const char *feats,
+                          const cst_lts_phone *phones, int n)
+{
+    cst_lts_cache_entry *e = &lts_cache[h % CST_LTS_CACHE_SIZE];
+    char *key;
+    cst_lts_phone *kphones;
+    int wlen = cst_strlen(word);
+
+    key = cst_alloc(char,wlen+cst_strlen(feats)+2);
+    memmove(key,word,wlen+1);
+    memmove(key+wlen+1,feats,cst_strlen(feats)+1);
+    kphones = cst_alloc(cst_lts_phone,n+1);
+    memmove(kphones,phones,n*sizeof(cst_lts_phone));
+
+    lts_cache_lock();
+    cst_free(e->key);
+    cst_free(e->phones);
+    e->r = r;
+    e->hash = h;
+    e->key = key;
+    e->phones = kphones;
+    e->num_phones = n;
+    lts_cache_unlock();
+}
+
 cst_lts_rules *new_lts_rules()
 {
     cst_lts_rules *lt = cst_alloc(cst_lts_rules,1);
@@ -92,36 +176,38 @@ cst_val *lts_apply_val(const cst_val *wlist,const char *feats,const cst_lts_rule
     return p;
 }
 
-cst_val *lts_apply(const char *word,const char *feats,const cst_lts_rules *r)
+/* Predict the phones for each letter, last letter first, not keeping */
+/* epsilons, returns how many there are                               */
+static int lts_predict(const char *word,const char *feats,
+                       const cst_lts_rules *r,cst_lts_phone *phones)
 {
-    int pos, index, i;
-    cst_val *phones=0;
+    int pos, index, i, n=0;
     cst_lts_letter *fval_buff;
     cst_lts_letter *full_buff;
     cst_lts_phone phone;
-    char *left, *right;
-    const char *p;
     char hash;
     char zeros[8];
+    int cws = r->context_window_size;
+    int flen = cst_strlen(feats);
     
     /* For feature vals for each letter */
     fval_buff = cst_alloc(cst_lts_letter,
-			  (r->context_window_size*2)+
-			   r->context_extra_feats);
+			  (cws*2)+
+			   r->context_extra_feats+flen+1);
     /* Buffer with added contexts */
     full_buff = cst_alloc(cst_lts_letter,
-			  (r->context_window_size*2)+
+			  (cws*2)+
 			  cst_strlen(word)+1); /* TBD assumes single POS feat */
     if (r->letter_table)
     {
 	for (i=0; i<8; i++) zeros[i] = 2;
 	cst_sprintf((char *)full_buff,
                     "%.*s%c%s%c%.*s",
-		    r->context_window_size-1, zeros,
+		    cws-1, zeros,
 		    1,
 		    word,
 		    1,
-		    r->context_window_size-1, zeros);
+		    cws-1, zeros);
 	hash = 1;
     }
     else
@@ -129,25 +215,20 @@ cst_val *lts_apply(const char *word,const char *feats,const cst_lts_rules *r)
 	/* Assumes l_letter is a char and context < 8 */
 	cst_sprintf((char *)full_buff,
                     "%.*s#%s#%.*s",
-		    r->context_window_size-1, "00000000",
+		    cws-1, "00000000",
 		    word,
-		    r->context_window_size-1, "00000000");
+		    cws-1, "00000000");
 	hash = '#';
     }
 
+    /* The feats are the same for every letter */
+    memmove(fval_buff+cws*2,feats,flen+1);
+
     /* Do the prediction backwards so we don't need to reverse the answer */
-    for (pos = r->context_window_size + cst_strlen(word) - 1;
+    for (pos = cws + cst_strlen(word) - 1;
 	 full_buff[pos] != hash;
 	 pos--)
     {
-	/* Fill the features buffer for the predictor */
-	cst_sprintf((char *)fval_buff,
-                    "%.*s%.*s%s",
-		    r->context_window_size,
-		    full_buff+pos-r->context_window_size,
-		    r->context_window_size,
-		    full_buff+pos+1,
-		    feats);
 	if ((!r->letter_table
 	     && ((full_buff[pos] < 'a') || (full_buff[pos] > 'z'))))
 	{   
@@ -157,6 +238,10 @@ cst_val *lts_apply(const char *word,const char *feats,const cst_lts_rules *r)
 #endif
 	    continue;
 	}
+	/* Fill the features buffer for the predictor, the contexts never */
+        /* have nuls in them                                              */
+        memmove(fval_buff,full_buff+pos-cws,cws);
+        memmove(fval_buff+cws,full_buff+pos+1,cws);
 	if (r->letter_table)
 	    index = full_buff[pos] - 3;
 	else
@@ -170,15 +255,42 @@ cst_val *lts_apply(const char *word,const char *feats,const cst_lts_rules *r)
                full_buff[pos],
                (const char *)r->phone_table[phone]);
 #endif
-	/* delete epsilons and split dual-phones */
-	if (cst_streq("epsilon",r->phone_table[phone]))
-	    continue;
-	else if ((p=strchr(r->phone_table[phone],'-')) != NULL)
+	if (!cst_streq("epsilon",r->phone_table[phone]))
+            phones[n++] = phone;
+    }
+
+    cst_free(full_buff);
+    cst_free(fval_buff);
+    
+    return n;
+}
+
+cst_val *lts_apply(const char *word,const char *feats,const cst_lts_rules *r)
+{
+    int i, n;
+    cst_val *phones=0;
+    cst_lts_phone *predicted;
+    char *left, *right;
+    const char *p, *ph;
+    unsigned int h;
+
+    predicted = cst_alloc(cst_lts_phone,cst_strlen(word)+1);
+    h = lts_hash(r,word,feats);
+    if ((n = lts_cache_lookup(r,h,word,feats,predicted)) < 0)
+    {
+        n = lts_predict(word,feats,r,predicted);
+        lts_cache_add(r,h,word,feats,predicted,n);
+    }
+
+    /* predicted is backwards, so consing puts the phones in order */
+    for (i=0; i<n; i++)
+    {
+        ph = r->phone_table[predicted[i]];
+	/* split dual-phones */
+	if ((p=strchr(ph,'-')) != NULL)
 	{
-	    left = cst_substr(r->phone_table[phone],0,
-			      cst_strlen(r->phone_table[phone])-cst_strlen(p));
-	    right = cst_substr(r->phone_table[phone],
-			       (cst_strlen(r->phone_table[phone])-cst_strlen(p))+1,
+	    left = cst_substr(ph,0,cst_strlen(ph)-cst_strlen(p));
+	    right = cst_substr(ph,(cst_strlen(ph)-cst_strlen(p))+1,
 			       (cst_strlen(p)-1));
 	    phones = cons_val(string_val(left),
 			      cons_val(string_val(right),phones));
@@ -186,52 +298,33 @@ cst_val *lts_apply(const char *word,const char *feats,const cst_lts_rules *r)
 	    cst_free(right);
 	}
 	else
-	    phones = cons_val(string_val(r->phone_table[phone]),phones);
+	    phones = cons_val(string_val(ph),phones);
     }
 
-    cst_free(full_buff);
-    cst_free(fval_buff);
+    cst_free(predicted);
     
     return phones;
 }
 
-static void cst_lts_get_state(cst_lts_rule *state,
-			      const cst_lts_model *model,
-			      unsigned short n,
-			      int rule_size)
-{   /* As some OS's require a more elaborate access than a simple lookup */
-    memmove(state,&model[n*rule_size],rule_size);
-}
-
 static cst_lts_phone apply_model(cst_lts_letter *vals,cst_lts_addr start, 
 				 const cst_lts_model *model)
 {
-    /* because some machines (arm/mips) can't deal with addrs not on     */
-    /* word boundaries we use a static and copy the rule values each time */
-    /* so we know its properly aligned                                    */
-    /* Hmm this still might be wrong on some machines that align the      */
-    /* structure cst_lts_rules differently                                */
-    cst_lts_rule state;
-    unsigned short nstate;
-    static const int sizeof_cst_lts_rule = 6;
-
-    cst_lts_get_state(&state,model,start,sizeof_cst_lts_rule);
-    for ( ;
-	 state.feat != CST_LTS_EOR;
-	)
+    /* Rules are 6 bytes: feat, val, then the true and false next rules */
+    /* as little endian shorts.  Read them a byte at a time straight    */
+    /* from the model, which works whatever the alignment and byte      */
+    /* order, rather than copying each rule out                         */
+    const cst_lts_model *state;
+
+    for (state = &model[start*6]; 
+         state[0] != CST_LTS_EOR; )
     {
-	/* printf("awb_debug %s %c %c %d\n",vals,vals[state.feat],state.val, 
-           (vals[state.feat] == state.val) ? 1 : 0);  */
-	if (vals[state.feat] == state.val)
-	    nstate = state.qtrue;
+	/* printf("awb_debug %s %c %c %d\n",vals,vals[state[0]],state[1], 
+           (vals[state[0]] == state[1]) ? 1 : 0);  */
+	if (vals[state[0]] == state[1])
+	    state = &model[(state[2] | (state[3] << 8))*6];
 	else
-	    nstate = state.qfalse;
-	/* This should really happen at compilation time */
-	if (CST_BIG_ENDIAN)
-	    nstate = SWAPSHORT(nstate);
-
-	cst_lts_get_state(&state,model,nstate,sizeof_cst_lts_rule);
+	    state = &model[(state[4] | (state[5] << 8))*6];
     }
 
-    return (cst_lts_phone)state.val;
+    return (cst_lts_phone)state[1];
 }
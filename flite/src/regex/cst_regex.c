@@ -43,6 +43,8 @@
 
 #include "cst_regex_defs.h"
 
+#include <stdint.h>
+
 /* For access by const models */
 const cst_regex *const cst_regex_table[] = {
 	&cst_rx_dotted_abbrev_rx
@@ -50,9 +52,65 @@ const cst_regex *const cst_regex_table[] = {
 
 static char *regularize(const char *unregex,int match);
 
+/* DFAs for the regexes that have been matched, found by the regex's   */
+/* address.  A slot is claimed by setting its regex and the DFA is     */
+/* published after it's built, until then, or if the regex can't be a  */
+/* DFA, matching falls back to the backtracking matcher                */
+#define CST_REGEX_DFA_SLOTS 128
+static struct {
+    const cst_regex *r;
+    cst_regex_dfa *dfa;
+} cst_regex_dfas[CST_REGEX_DFA_SLOTS];
+
+#if defined(__GNUC__) || defined(__clang__)
+#define rx_load(P) __atomic_load_n(P,__ATOMIC_ACQUIRE)
+#define rx_store(P,V) __atomic_store_n(P,V,__ATOMIC_RELEASE)
+#define rx_claim(P,V) \
+    __atomic_compare_exchange_n(P,&(const cst_regex *){NULL},V,0, \
+                                __ATOMIC_ACQ_REL,__ATOMIC_ACQUIRE)
+#else
+#define rx_load(P) (*(P))
+#define rx_store(P,V) (*(P) = (V))
+#define rx_claim(P,V) ((*(P) == NULL) ? (*(P) = (V), 1) : 0)
+#endif
+
+static const cst_regex_dfa *cst_regex_find_dfa(const cst_regex *r)
+{
+    const cst_regex *k;
+    unsigned int i, n;
+
+    i = (unsigned int)(((uintptr_t)r >> 4) % CST_REGEX_DFA_SLOTS);
+    for (n=0; n < CST_REGEX_DFA_SLOTS; n++)
+    {
+        k = rx_load(&cst_regex_dfas[i].r);
+        if (k == r)
+            return rx_load(&cst_regex_dfas[i].dfa);
+        else if ((k == NULL) && rx_claim(&cst_regex_dfas[i].r,r))
+        {
+            rx_store(&cst_regex_dfas[i].dfa,cst_regex_dfa_compile(r));
+            return rx_load(&cst_regex_dfas[i].dfa);
+        }
+        else if (k == NULL)
+            continue; /* someone else just took it, look again */
+        i = (i+1) % CST_REGEX_DFA_SLOTS;
+    }
+
+    return NULL; /* table full */
+}
+
 void cst_regex_init()
 {
-    /* no need to initialize regexes anymore, they are pre-compiled */
+    /* Regexes are pre-compiled, but build the DFAs for the common ones */
+    static const cst_regex * const *common[] = {
+        &cst_rx_white, &cst_rx_alpha, &cst_rx_uppercase, &cst_rx_lowercase,
+        &cst_rx_alphanum, &cst_rx_identifier, &cst_rx_int, &cst_rx_double,
+        &cst_rx_commaint, &cst_rx_digits, &cst_rx_dotted_abbrev, NULL };
+    int i;
+
+    for (i=0; common[i]; i++)
+        cst_regex_find_dfa(*common[i]);
+    for (i=0; i<=CST_RX_dotted_abbrev_NUM; i++)
+        cst_regex_find_dfa(cst_regex_table[i]);
 
     return;
 }
@@ -60,8 +118,11 @@ void cst_regex_init()
 int cst_regex_match(const cst_regex *r, const char *str)
 {
     cst_regstate *s;
+    const cst_regex_dfa *d;
 
     if (r == NULL) return 0;
+    if ((str != NULL) && ((d = cst_regex_find_dfa(r)) != NULL))
+        return cst_regex_dfa_match(d, str);
     s = hs_regexec(r, str);
     if (s) {
 	cst_free(s);
@@ -91,8 +152,20 @@ cst_regex *new_cst_regex(const char *str)
 
 void delete_cst_regex(cst_regex *r)
 {
+    int i;
+
     if (r)
+    {
+        /* The slot stays taken, a new regex at this address just won't */
+        /* get a DFA                                                     */
+        for (i=0; i < CST_REGEX_DFA_SLOTS; i++)
+            if (cst_regex_dfas[i].r == r)
+            {
+                cst_regex_dfa_delete(cst_regex_dfas[i].dfa);
+                rx_store(&cst_regex_dfas[i].dfa,NULL);
+            }
 	hs_regdelete(r);
+    }
 
     return;
 }
@@ -0,0 +1,458 @@
+/*************************************************************************/
+/*                                                                       */
+/*                  Language Technologies Institute                      */
+/*                     Carnegie Mellon University                        */
+/*                        Copyright (c) 1999                             */
+/*                        All Rights Reserved.                           */
+/*                                                                       */
+/*  Permission is hereby granted, free of charge, to use and distribute  */
+/*  this software and its documentation without restriction, including   */
+/*  without limitation the rights to use, copy, modify, merge, publish,  */
+/*  distribute, sublicense, and/or sell copies of this work, and to      */
+/*  permit persons to whom this work is furnished to do so, subject to   */
+/*  the following conditions:                                            */
+/*   1. The code must retain the above copyright notice, this list of    */
+/*      conditions and the following disclaimer.                         */
+/*   2. Any modifications must be clearly marked as such.                */
+/*   3. Original authors' names are not deleted.                         */
+/*   4. The authors' names are not used to endorse or promote products   */
+/*      derived from this software without specific prior written        */
+/*      permission.                                                      */
+/*                                                                       */
+/*  CARNEGIE MELLON UNIVERSITY AND THE CONTRIBUTORS TO THIS WORK         */
+/*  DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE, INCLUDING      */
+/*  ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO EVENT   */
+/*  SHALL CARNEGIE MELLON UNIVERSITY NOR THE CONTRIBUTORS BE LIABLE      */
+/*  FOR ANY SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES    */
+/*  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN   */
+/*  AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION,          */
+/*  ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF       */
+/*  THIS SOFTWARE.                                                       */
+/*                                                                       */
+/*************************************************************************/
+/*             Author:  Alan W Black (awb@cs.cmu.edu)                    */
+/*                                                                       */
+/*  Regexes compiled to DFAs.  Spencer programs (as in cst_regex_defs.h  */
+/*  and the language specific *_regexes.h) are turned into a DFA by      */
+/*  subset construction so matching is linear and allocates nothing.    */
+/*  Programs using constructs the DFA doesn't do (\< and \>) are left to */
+/*  the backtracking matcher in regexp.c                                 */
+/*                                                                       */
+/*************************************************************************/
+#include "cst_alloc.h"
+#include "cst_regex.h"
+
+/* Spencer program opcodes and layout, from regexp.c */
+#define	END	0
+#define	BOL	1
+#define	EOL	2
+#define	ANY	3
+#define	ANYOF	4
+#define	ANYBUT	5
+#define	BRANCH	6
+#define	BACK	7
+#define	EXACTLY	8
+#define	NOTHING	9
+#define	STAR	10
+#define	PLUS	11
+#define	OPEN	20
+#define	CLOSE	30
+#define	OP(p)	(*(p))
+#define	NEXT(p)	(((*((p)+1)&0377)<<8) + (*((p)+2)&0377))
+#define	OPERAND(p)	((p) + 3)
+
+/* Bigger DFAs than this are left to the backtracking matcher */
+#define CST_REGEX_DFA_MAX_STATES 256
+
+#define DFA_ACCEPT 1        /* matched, whatever follows */
+#define DFA_ACCEPT_AT_END 2 /* matched if the string ends here */
+
+struct cst_regex_dfa_struct {
+    unsigned char class_of[256]; /* chars to equivalence classes */
+    int num_classes;
+    int num_states;
+    short *trans;                /* num_states x num_classes, -1 is dead */
+    unsigned char *flags;
+};
+
+/* The NFA is the set of consuming positions in the program: the byte   */
+/* offset of ANY/ANYOF/ANYBUT/STAR/PLUS nodes, of each character in an  */
+/* EXACTLY, and one past a PLUS for after it has matched once           */
+typedef struct dfa_build_struct {
+    const char *prog;
+    int size;               /* bytes in prog */
+    int words;              /* ints in a position set */
+    int *node_of;           /* node each position belongs to */
+    unsigned char *visited; /* per step: offset x (bol,eol) */
+    int unsupported;
+    int num_states;
+    unsigned int *sets;     /* position set of each state */
+    unsigned char *flags;
+} dfa_build;
+
+static const char *dfa_next(const char *p)
+{
+    int offset = NEXT(p);
+
+    if (offset == 0)
+        return NULL;
+    else if (OP(p) == BACK)
+        return p-offset;
+    else
+        return p+offset;
+}
+
+/* Add the consuming positions reachable from p without input */
+static void dfa_closure(dfa_build *b, const char *p, int bol, int eol,
+                        unsigned int *set, unsigned char *flags)
+{
+    const char *br;
+    int off;
+
+    while (p)
+    {
+        off = p - b->prog;
+        if (b->visited[off*4+bol*2+eol])
+            return;
+        b->visited[off*4+bol*2+eol] = 1;
+
+        switch (OP(p))
+        {
+        case END:
+            *flags |= eol ? DFA_ACCEPT_AT_END : DFA_ACCEPT;
+            return;
+        case BOL:
+            if (!bol)
+                return;
+            p = dfa_next(p);
+            break;
+        case EOL:
+            eol = 1;
+            p = dfa_next(p);
+            break;
+        case BRANCH:
+            if ((dfa_next(p) == NULL) || (OP(dfa_next(p)) != BRANCH))
+                p = OPERAND(p); /* No choice */
+            else
+            {
+                for (br = p; br && OP(br) == BRANCH; br = dfa_next(br))
+                    dfa_closure(b,OPERAND(br),bol,eol,set,flags);
+                return;
+            }
+            break;
+        case ANY: case ANYOF: case ANYBUT: case STAR: case PLUS:
+        case EXACTLY:
+            /* Nothing can be consumed once we're past the end */
+            if (!eol)
+            {
+                if (OP(p) == EXACTLY)
+                    off += 3;
+                set[off/32] |= 1u << (off%32);
+            }
+            if (OP(p) != STAR)
+                return;
+            p = dfa_next(p);
+            break;
+        default:
+            if ((OP(p) == BACK) || (OP(p) == NOTHING) ||
+                ((OP(p) > OPEN) && (OP(p) <= OPEN+9)) ||
+                ((OP(p) > CLOSE) && (OP(p) <= CLOSE+9)))
+                p = dfa_next(p);
+            else
+            {   /* \< \> or something broken */
+                b->unsupported = 1;
+                return;
+            }
+        }
+    }
+}
+
+/* Does the simple STAR/PLUS operand at p match c */
+static int dfa_simple_match(const char *p, int c)
+{
+    switch (OP(p))
+    {
+    case ANY:
+        return 1;
+    case EXACTLY:
+        return (unsigned char)*OPERAND(p) == c;
+    case ANYOF:
+        return strchr(OPERAND(p),c) != NULL;
+    case ANYBUT:
+        return strchr(OPERAND(p),c) == NULL;
+    default:
+        return 0;
+    }
+}
+
+/* Note which node each position belongs to, walking the nodes in */
+/* program order as regdump() does                                   */
+static void dfa_find_nodes(dfa_build *b)
+{
+    const char *p;
+    int op, i;
+
+    for (i=0; i < b->size; i++)
+        b->node_of[i] = -1;
+
+    for (p = b->prog+1, op = EXACTLY; (op != END) && (p < b->prog+b->size); )
+    {
+        op = OP(p);
+        b->node_of[p-b->prog] = p-b->prog;
+        b->node_of[p-b->prog+1] = p-b->prog; /* PLUS matched once */
+        if ((op == ANYOF) || (op == ANYBUT) || (op == EXACTLY))
+        {
+            for (i=3; p[i]; i++)
+                b->node_of[p-b->prog+i] = p-b->prog;
+            p += i+1;
+        }
+        else
+            p += 3;
+    }
+}
+
+/* The positions reached from set on c, and what they accept */
+static void dfa_step(dfa_build *b, const unsigned int *set, int c,
+                     unsigned int *nset, unsigned char *nflags)
+{
+    const char *p;
+    int off;
+
+    memset(nset,0,b->words*sizeof(unsigned int));
+    memset(b->visited,0,b->size*4);
+    *nflags = 0;
+
+    for (off=0; off < b->size; off++)
+    {
+        if ((set[off/32] & (1u << (off%32))) == 0)
+            continue;
+        p = b->prog + b->node_of[off];
+        switch (OP(p))
+        {
+        case ANY:
+            dfa_closure(b,dfa_next(p),0,0,nset,nflags);
+            break;
+        case ANYOF:
+        case ANYBUT:
+            if (dfa_simple_match(p,c))
+                dfa_closure(b,dfa_next(p),0,0,nset,nflags);
+            break;
+        case EXACTLY:
+            if ((unsigned char)b->prog[off] != c)
+                break;
+            if (b->prog[off+1])
+            {   /* on to the next char of the string */
+                nset[(off+1)/32] |= 1u << ((off+1)%32);
+            }
+            else
+                dfa_closure(b,dfa_next(p),0,0,nset,nflags);
+            break;
+        case STAR:
+            if (dfa_simple_match(OPERAND(p),c))
+                dfa_closure(b,p,0,0,nset,nflags);
+            break;
+        case PLUS:
+            if (dfa_simple_match(OPERAND(p),c))
+            {   /* it can now repeat or move on */
+                nset[(p+1-b->prog)/32] |= 1u << ((p+1-b->prog)%32);
+                dfa_closure(b,dfa_next(p),0,0,nset,nflags);
+            }
+            break;
+        }
+    }
+}
+
+/* Split the classes by membership of the chars in "in" */
+static int dfa_refine(unsigned char *class_of, const unsigned char *in,
+                      int num_classes)
+{
+    short remap[256][2];
+    int c, n = 0;
+
+    for (c=0; c<num_classes; c++)
+        remap[c][0] = remap[c][1] = -1;
+    for (c=0; c<256; c++)
+    {
+        if (remap[class_of[c]][in[c]] == -1)
+            remap[class_of[c]][in[c]] = n++;
+        class_of[c] = remap[class_of[c]][in[c]];
+    }
+
+    return n;
+}
+
+/* Chars that every node treats the same share a class */
+static int dfa_classes(dfa_build *b, unsigned char *class_of)
+{
+    unsigned char in[256];
+    const char *p, *q;
+    int op, num_classes = 1;
+
+    memset(class_of,0,256);
+    for (p = b->prog+1, op = EXACTLY; (op != END) && (p < b->prog+b->size); )
+    {
+        op = OP(p);
+        if ((op == ANYOF) || (op == ANYBUT) || (op == EXACTLY))
+        {
+            memset(in,0,256);
+            for (q = OPERAND(p); *q; q++)
+            {
+                in[(unsigned char)*q] = 1;
+                if (op == EXACTLY)
+                {   /* each char of a string is a set of its own */
+                    num_classes = dfa_refine(class_of,in,num_classes);
+                    in[(unsigned char)*q] = 0;
+                }
+            }
+            if (op != EXACTLY)
+                num_classes = dfa_refine(class_of,in,num_classes);
+            p = q+1;
+        }
+        else
+            p += 3;
+    }
+
+    return num_classes;
+}
+
+static int dfa_add_state(dfa_build *b, const unsigned int *set,
+                         unsigned char flags)
+{
+    int i;
+
+    for (i=0; i < b->num_states; i++)
+        if ((b->flags[i] == flags) &&
+            (memcmp(&b->sets[i*b->words],set,
+                    b->words*sizeof(unsigned int)) == 0))
+            return i;
+
+    if (b->num_states == CST_REGEX_DFA_MAX_STATES)
+    {
+        b->unsupported = 1;
+        return -1;
+    }
+    memmove(&b->sets[b->num_states*b->words],set,
+            b->words*sizeof(unsigned int));
+    b->flags[b->num_states] = flags;
+    return b->num_states++;
+}
+
+static int dfa_empty(const dfa_build *b, const unsigned int *set)
+{
+    int i;
+
+    for (i=0; i < b->words; i++)
+        if (set[i])
+            return FALSE;
+    return TRUE;
+}
+
+cst_regex_dfa *cst_regex_dfa_compile(const cst_regex *r)
+{
+    cst_regex_dfa *d;
+    dfa_build b;
+    unsigned int *set;
+    unsigned char flags;
+    int s, c, k, n;
+    int rep[256];
+
+    if ((r == NULL) || (r->program == NULL) ||
+        ((unsigned char)r->program[0] != CST_REGMAGIC))
+        return NULL;
+
+    memset(&b,0,sizeof(b));
+    b.prog = r->program;
+    b.size = r->regsize;
+    b.words = (b.size+31)/32;
+    b.visited = cst_alloc(unsigned char,b.size*4);
+    b.node_of = cst_alloc(int,b.size+1);
+    b.sets = cst_alloc(unsigned int,b.words*(CST_REGEX_DFA_MAX_STATES+1));
+    b.flags = cst_alloc(unsigned char,CST_REGEX_DFA_MAX_STATES);
+    set = &b.sets[b.words*CST_REGEX_DFA_MAX_STATES]; /* scratch */
+    dfa_find_nodes(&b);
+
+    d = cst_alloc(cst_regex_dfa,1);
+    d->num_classes = dfa_classes(&b,d->class_of);
+    /* A char to stand for each class, nul never needs one */
+    for (c=0; c<256; c++)
+        rep[c] = -1;
+    for (c=255; c>0; c--)
+        rep[d->class_of[c]] = c;
+    d->trans = cst_alloc(short,CST_REGEX_DFA_MAX_STATES*d->num_classes);
+
+    /* The start state, at the beginning of the string */
+    memset(set,0,b.words*sizeof(unsigned int));
+    flags = 0;
+    dfa_closure(&b,b.prog+1,1,0,set,&flags);
+    dfa_add_state(&b,set,flags);
+
+    for (s=0; (s < b.num_states) && !b.unsupported; s++)
+    {
+        for (k=0; k < d->num_classes; k++)
+        {
+            if (rep[k] < 0)
+            {
+                d->trans[s*d->num_classes+k] = -1;
+                continue;
+            }
+            dfa_step(&b,&b.sets[s*b.words],rep[k],set,&flags);
+            if (!r->reganch)
+            {   /* a match may start anywhere */
+                memset(b.visited,0,b.size*4);
+                dfa_closure(&b,b.prog+1,0,0,set,&flags);
+            }
+            if (dfa_empty(&b,set) && (flags == 0))
+                n = -1;
+            else
+                n = dfa_add_state(&b,set,flags);
+            d->trans[s*d->num_classes+k] = n;
+        }
+    }
+
+    if (b.unsupported)
+    {
+        cst_free(d->trans);
+        cst_free(d);
+        d = NULL;
+    }
+    else
+    {
+        d->num_states = b.num_states;
+        d->flags = cst_alloc(unsigned char,b.num_states);
+        memmove(d->flags,b.flags,b.num_states);
+    }
+
+    cst_free(b.visited);
+    cst_free(b.node_of);
+    cst_free(b.sets);
+    cst_free(b.flags);
+
+    return d;
+}
+
+void cst_regex_dfa_delete(cst_regex_dfa *d)
+{
+    if (d)
+    {
+        cst_free(d->trans);
+        cst_free(d->flags);
+        cst_free(d);
+    }
+}
+
+int cst_regex_dfa_match(const cst_regex_dfa *d, const char *str)
+{
+    const unsigned char *s = (const unsigned char *)str;
+    int state = 0;
+
+    for ( ; ; s++)
+    {
+        if (d->flags[state] & DFA_ACCEPT)
+            return 1;
+        else if (*s == '\0')
+            return (d->flags[state] & DFA_ACCEPT_AT_END) != 0;
+        state = d->trans[state*d->num_classes+d->class_of[*s]];
+        if (state < 0)
+            return 0;
+    }
+}
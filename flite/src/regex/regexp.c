@@ -162,13 +162,16 @@
 #define	WORST		0	/* Worst case. */
 
 /*
- * Global work variables for regcomp().
+ * Work variables for regcomp(), kept in a state structure (rather than
+ * globals) so that regexes can be compiled on several threads at once.
  */
-static const char *regparse;		/* Input-scan pointer. */
-static int regnpar;		/* () count. */
-static char regdummy;
-static char *regcode;		/* Code-emit pointer; &regdummy = don't. */
-static long regsize;		/* Code size. */
+typedef struct regcomp_state_struct {
+	const char *regparse;	/* Input-scan pointer. */
+	int regnpar;		/* () count. */
+	char regdummy;
+	char *regcode;		/* Code-emit pointer; &regdummy = don't. */
+	long regsize;		/* Code size. */
+} regcomp_state;
 
 /*
  * Forward declarations for regcomp()'s friends.
@@ -176,16 +179,16 @@ static long regsize;		/* Code size. */
 #ifndef STATIC
 #define	STATIC	static
 #endif
-STATIC char *reg(int paren, int *flagp);
-STATIC char *regbranch(int *flagp);
-STATIC char *regpiece(int *flagp);
-STATIC char *regatom(int *flagp);
-STATIC char *regnode(char op);
+STATIC char *reg(regcomp_state *cs, int paren, int *flagp);
+STATIC char *regbranch(regcomp_state *cs, int *flagp);
+STATIC char *regpiece(regcomp_state *cs, int *flagp);
+STATIC char *regatom(regcomp_state *cs, int *flagp);
+STATIC char *regnode(regcomp_state *cs, char op);
 STATIC char *regnext(register char *p);
-STATIC void regc(char b);
-STATIC void reginsert(char op, char *opnd);
-STATIC void regtail(char *p, char *val);
-STATIC void regoptail(char *p, char *val);
+STATIC void regc(regcomp_state *cs, char b);
+STATIC void reginsert(regcomp_state *cs, char op, char *opnd);
+STATIC void regtail(regcomp_state *cs, char *p, char *val);
+STATIC void regoptail(regcomp_state *cs, char *p, char *val);
 #ifdef STRCSPN
 STATIC int strcspn();
 #endif
@@ -213,6 +216,9 @@ hs_regcomp(const char *exp)
 	char *longest;
 	unsigned int len;
 	int flags;
+	regcomp_state state;
+	regcomp_state *cs = &state;
+
 	if (exp == NULL)
 		FAIL("NULL argument");
 
@@ -220,31 +226,31 @@ hs_regcomp(const char *exp)
 #ifdef notdef
 	if (exp[0] == '.' && exp[1] == '*') exp += 2;  /* aid grep */
 #endif
-	regparse = exp;
-	regnpar = 1;
-	regsize = 0L;
-	regcode = &regdummy;
-	regc(CST_REGMAGIC);
-	if (reg(0, &flags) == NULL)
+	cs->regparse = exp;
+	cs->regnpar = 1;
+	cs->regsize = 0L;
+	cs->regcode = &cs->regdummy;
+	regc(cs, CST_REGMAGIC);
+	if (reg(cs, 0, &flags) == NULL)
 		return(NULL);
 
 	/* Small enough for pointer-storage convention? */
-	if (regsize >= 32767L)		/* Probably could be 65535L. */
+	if (cs->regsize >= 32767L)		/* Probably could be 65535L. */
 		FAIL("regexp too big");
 
 	/* Allocate space. */
 	r = cst_alloc(cst_regex,1);
-	r->regsize = regsize;
-	r->program = cst_alloc(char,regsize);
+	r->regsize = cs->regsize;
+	r->program = cst_alloc(char,cs->regsize);
 	if (r == NULL)
 		FAIL("out of space");
 
 	/* Second pass: emit code. */
-	regparse = exp;
-	regnpar = 1;
-	regcode = r->program;
-	regc(CST_REGMAGIC);
-	if (reg(0, &flags) == NULL)
+	cs->regparse = exp;
+	cs->regnpar = 1;
+	cs->regcode = r->program;
+	regc(cs, CST_REGMAGIC);
+	if (reg(cs, 0, &flags) == NULL)
 		return(NULL);
 
 	/* Dig out information for optimizations. */
@@ -305,7 +311,7 @@ hs_regdelete(cst_regex *r)
  * follows makes it hard to avoid.
  */
 static char *
-reg(int paren, int *flagp)
+reg(regcomp_state *cs, int paren, int *flagp)
           			/* Parenthesized? */
            
 {
@@ -319,49 +325,50 @@ reg(int paren, int *flagp)
 
 	/* Make an OPEN node, if parenthesized. */
 	if (paren) {
-		if (regnpar >= CST_NSUBEXP)
+		if (cs->regnpar >= CST_NSUBEXP)
 			FAIL("too many ()");
-		parno = regnpar;
-		regnpar++;
-		ret = regnode(OPEN+parno);
+		parno = cs->regnpar;
+		cs->regnpar++;
+		ret = regnode(cs, OPEN+parno);
 	} else
 		ret = NULL;
 
 	/* Pick up the branches, linking them together. */
-	br = regbranch(&flags);
+	br = regbranch(cs, &flags);
 	if (br == NULL)
 		return(NULL);
 	if (ret != NULL)
-		regtail(ret, br);	/* OPEN -> first. */
+		regtail(cs, ret, br);	/* OPEN -> first. */
 	else
 		ret = br;
 	if (!(flags&HASWIDTH))
 		*flagp &= ~HASWIDTH;
 	*flagp |= flags&SPSTART;
-	while (*regparse == '|' || *regparse == '\n') {
-		regparse++;
-		br = regbranch(&flags);
+	while (*cs->regparse == '|' || *cs->regparse == '\n') {
+		cs->regparse++;
+		br = regbranch(cs, &flags);
 		if (br == NULL)
 			return(NULL);
-		regtail(ret, br);	/* BRANCH -> BRANCH. */
+		regtail(cs, ret, br);	/* BRANCH -> BRANCH. */
 		if (!(flags&HASWIDTH))
 			*flagp &= ~HASWIDTH;
 		*flagp |= flags&SPSTART;
 	}
 
 	/* Make a closing node, and hook it on the end. */
-	ender = regnode((paren) ? CLOSE+parno : END);
-	regtail(ret, ender);
+	ender = regnode(cs, (paren) ? CLOSE+parno : END);
+	regtail(cs, ret, ender);
 
 	/* Hook the tails of the branches to the closing node. */
-	for (br = ret; br != NULL; br = regnext(br))
-		regoptail(br, ender);
+	if (ret != &cs->regdummy)
+		for (br = ret; br != NULL; br = regnext(br))
+			regoptail(cs, br, ender);
 
 	/* Check for proper termination. */
-	if (paren && *regparse++ != ')') {
+	if (paren && *cs->regparse++ != ')') {
 		FAIL("unmatched ()");
-	} else if (!paren && *regparse != '\0') {
-		if (*regparse == ')') {
+	} else if (!paren && *cs->regparse != '\0') {
+		if (*cs->regparse == ')') {
 			FAIL("unmatched ()");
 		} else
 			FAIL("junk on end");	/* "Can't happen". */
@@ -377,7 +384,7 @@ reg(int paren, int *flagp)
  * Implements the concatenation operator.
  */
 static char *
-regbranch(int *flagp)
+regbranch(regcomp_state *cs, int *flagp)
 {
 	char *ret;
 	char *chain;
@@ -386,22 +393,22 @@ regbranch(int *flagp)
 
 	*flagp = WORST;		/* Tentatively. */
 
-	ret = regnode(BRANCH);
+	ret = regnode(cs, BRANCH);
 	chain = NULL;
-	while (*regparse != '\0' && *regparse != ')' &&
-	       *regparse != '\n' && *regparse != '|') {
-		latest = regpiece(&flags);
+	while (*cs->regparse != '\0' && *cs->regparse != ')' &&
+	       *cs->regparse != '\n' && *cs->regparse != '|') {
+		latest = regpiece(cs, &flags);
 		if (latest == NULL)
 			return(NULL);
 		*flagp |= flags&HASWIDTH;
 		if (chain == NULL)	/* First piece. */
 			*flagp |= flags&SPSTART;
 		else
-			regtail(chain, latest);
+			regtail(cs, chain, latest);
 		chain = latest;
 	}
 	if (chain == NULL)	/* Loop ran zero times. */
-		(void) regnode(NOTHING);
+		(void) regnode(cs, NOTHING);
 
 	return(ret);
 }
@@ -416,18 +423,18 @@ regbranch(int *flagp)
  * endmarker role is not redundant.
  */
 static char *
-regpiece(int *flagp)
+regpiece(regcomp_state *cs, int *flagp)
 {
 	char *ret;
 	char op;
 	char *next;
 	int flags;
 
-	ret = regatom(&flags);
+	ret = regatom(cs, &flags);
 	if (ret == NULL)
 		return(NULL);
 
-	op = *regparse;
+	op = *cs->regparse;
 	if (!ISMULT(op)) {
 		*flagp = flags;
 		return(ret);
@@ -438,33 +445,33 @@ regpiece(int *flagp)
 	*flagp = (op != '+') ? (WORST|SPSTART) : (WORST|HASWIDTH);
 
 	if (op == '*' && (flags&SIMPLE))
-		reginsert(STAR, ret);
+		reginsert(cs, STAR, ret);
 	else if (op == '*') {
 		/* Emit x* as (x&|), where & means "self". */
-		reginsert(BRANCH, ret);			/* Either x */
-		regoptail(ret, regnode(BACK));		/* and loop */
-		regoptail(ret, ret);			/* back */
-		regtail(ret, regnode(BRANCH));		/* or */
-		regtail(ret, regnode(NOTHING));		/* null. */
+		reginsert(cs, BRANCH, ret);			/* Either x */
+		regoptail(cs, ret, regnode(cs, BACK));		/* and loop */
+		regoptail(cs, ret, ret);			/* back */
+		regtail(cs, ret, regnode(cs, BRANCH));		/* or */
+		regtail(cs, ret, regnode(cs, NOTHING));		/* null. */
 	} else if (op == '+' && (flags&SIMPLE))
-		reginsert(PLUS, ret);
+		reginsert(cs, PLUS, ret);
 	else if (op == '+') {
 		/* Emit x+ as x(&|), where & means "self". */
-		next = regnode(BRANCH);			/* Either */
-		regtail(ret, next);
-		regtail(regnode(BACK), ret);		/* loop back */
-		regtail(next, regnode(BRANCH));		/* or */
-		regtail(ret, regnode(NOTHING));		/* null. */
+		next = regnode(cs, BRANCH);			/* Either */
+		regtail(cs, ret, next);
+		regtail(cs, regnode(cs, BACK), ret);		/* loop back */
+		regtail(cs, next, regnode(cs, BRANCH));		/* or */
+		regtail(cs, ret, regnode(cs, NOTHING));		/* null. */
 	} else if (op == '?') {
 		/* Emit x? as (x|) */
-		reginsert(BRANCH, ret);			/* Either x */
-		regtail(ret, regnode(BRANCH));		/* or */
-		next = regnode(NOTHING);		/* null. */
-		regtail(ret, next);
-		regoptail(ret, next);
+		reginsert(cs, BRANCH, ret);			/* Either x */
+		regtail(cs, ret, regnode(cs, BRANCH));		/* or */
+		next = regnode(cs, NOTHING);		/* null. */
+		regtail(cs, ret, next);
+		regoptail(cs, ret, next);
 	}
-	regparse++;
-	if (ISMULT(*regparse))
+	cs->regparse++;
+	if (ISMULT(*cs->regparse))
 		FAIL("nested *?+");
 
 	return(ret);
@@ -479,62 +486,62 @@ regpiece(int *flagp)
  * separate node; the code is simpler that way and it's not worth fixing.
  */
 static char *
-regatom(int *flagp)
+regatom(regcomp_state *cs, int *flagp)
 {
 	char *ret = NULL;
 	int flags;
 
 	*flagp = WORST;		/* Tentatively. */
 
-	switch (*regparse++) {
+	switch (*cs->regparse++) {
 	/* FIXME: these chars only have meaning at beg/end of pat? */
 	case '^':
-		ret = regnode(BOL);
+		ret = regnode(cs, BOL);
 		break;
 	case '$':
-		ret = regnode(EOL);
+		ret = regnode(cs, EOL);
 		break;
 	case '.':
-		ret = regnode(ANY);
+		ret = regnode(cs, ANY);
 		*flagp |= HASWIDTH|SIMPLE;
 		break;
 	case '[': {
 			int class1;
 			int classend;
 
-			if (*regparse == '^') {	/* Complement of range. */
-				ret = regnode(ANYBUT);
-				regparse++;
+			if (*cs->regparse == '^') {	/* Complement of range. */
+				ret = regnode(cs, ANYBUT);
+				cs->regparse++;
 			} else
-				ret = regnode(ANYOF);
-			if (*regparse == ']' || *regparse == '-')
-				regc(*regparse++);
-			while (*regparse != '\0' && *regparse != ']') {
-				if (*regparse == '-') {
-					regparse++;
-					if (*regparse == ']' || *regparse == '\0')
-						regc('-');
+				ret = regnode(cs, ANYOF);
+			if (*cs->regparse == ']' || *cs->regparse == '-')
+				regc(cs, *cs->regparse++);
+			while (*cs->regparse != '\0' && *cs->regparse != ']') {
+				if (*cs->regparse == '-') {
+					cs->regparse++;
+					if (*cs->regparse == ']' || *cs->regparse == '\0')
+						regc(cs, '-');
 					else {
-						class1 = UCHARAT(regparse-2)+1;
-						classend = UCHARAT(regparse);
+						class1 = UCHARAT(cs->regparse-2)+1;
+						classend = UCHARAT(cs->regparse);
 						if (class1 > classend+1)
 							FAIL("invalid [] range");
 						for (; class1 <= classend; class1++)
-							regc(class1);
-						regparse++;
+							regc(cs, class1);
+						cs->regparse++;
 					}
 				} else
-					regc(*regparse++);
+					regc(cs, *cs->regparse++);
 			}
-			regc('\0');
-			if (*regparse != ']')
+			regc(cs, '\0');
+			if (*cs->regparse != ']')
 				FAIL("unmatched []");
-			regparse++;
+			cs->regparse++;
 			*flagp |= HASWIDTH|SIMPLE;
 		}
 		break;
 	case '(':
-		ret = reg(1, &flags);
+		ret = reg(cs, 1, &flags);
 		if (ret == NULL)
 			return(NULL);
 		*flagp |= flags&(HASWIDTH|SPSTART);
@@ -551,15 +558,15 @@ regatom(int *flagp)
 		FAIL("?+* follows nothing");
 		break;
 	case '\\':
-		switch (*regparse++) {
+		switch (*cs->regparse++) {
 		case '\0':
 			FAIL("trailing \\");
 			break;
 		case '<':
-			ret = regnode(WORDA);
+			ret = regnode(cs, WORDA);
 			break;
 		case '>':
-			ret = regnode(WORDZ);
+			ret = regnode(cs, WORDZ);
 			break;
 		/* FIXME: Someday handle \1, \2, ... */
 		default:
@@ -576,7 +583,7 @@ regatom(int *flagp)
 		 * '*', '+', and '?' taking the SINGLE char previous
 		 * as their operand.
 		 *
-		 * On entry, the char at regparse[-1] is going to go
+		 * On entry, the char at cs->regparse[-1] is going to go
 		 * into the string, no matter what it is.  (It could be
 		 * following a \ if we are entered from the '\' case.)
 		 *
@@ -597,14 +604,14 @@ regatom(int *flagp)
 			const char *regprev;
 			char ch = 0;
 
-			regparse--;			/* Look at cur char */
-			ret = regnode(EXACTLY);
+			cs->regparse--;			/* Look at cur char */
+			ret = regnode(cs, EXACTLY);
 			for ( regprev = 0 ; ; ) {
-				ch = *regparse++;	/* Get current char */
-				switch (*regparse) {	/* look at next one */
+				ch = *cs->regparse++;	/* Get current char */
+				switch (*cs->regparse) {	/* look at next one */
 
 				default:
-					regc(ch);	/* Add cur to string */
+					regc(cs, ch);	/* Add cur to string */
 					break;
 
 				case '.': case '[': case '(':
@@ -613,19 +620,19 @@ regatom(int *flagp)
 				case '\0':
 				/* FIXME, $ and ^ should not always be magic */
 				magic:
-					regc(ch);	/* dump cur char */
+					regc(cs, ch);	/* dump cur char */
 					goto done;	/* and we are done */
 
 				case '?': case '+': case '*':
 					if (!regprev) 	/* If just ch in str, */
 						goto magic;	/* use it */
 					/* End mult-char string one early */
-					regparse = regprev; /* Back up parse */
+					cs->regparse = regprev; /* Back up parse */
 					goto done;
 
 				case '\\':
-					regc(ch);	/* Cur char OK */
-					switch (regparse[1]){ /* Look after \ */
+					regc(cs, ch);	/* Cur char OK */
+					switch (cs->regparse[1]){ /* Look after \ */
 					case '\0':
 					case '<':
 					case '>':
@@ -633,15 +640,15 @@ regatom(int *flagp)
 						goto done; /* Not quoted */
 					default:
 						/* Backup point is \, scan							 * point is after it. */
-						regprev = regparse;
-						regparse++;
+						regprev = cs->regparse;
+						cs->regparse++;
 						continue;	/* NOT break; */
 					}
 				}
-				regprev = regparse;	/* Set backup point */
+				regprev = cs->regparse;	/* Set backup point */
 			}
 		done:
-			regc('\0');
+			regc(cs, '\0');
 			*flagp |= HASWIDTH;
 			if (!regprev)		/* One char? */
 				*flagp |= SIMPLE;
@@ -656,14 +663,14 @@ regatom(int *flagp)
  - regnode - emit a node
  */
 static char *			/* Location. */
-regnode(char op)
+regnode(regcomp_state *cs, char op)
 {
 	char *ret;
 	char *ptr;
 
-	ret = regcode;
-	if (ret == &regdummy) {
-		regsize += 3;
+	ret = cs->regcode;
+	if (ret == &cs->regdummy) {
+		cs->regsize += 3;
 		return(ret);
 	}
 
@@ -671,7 +678,7 @@ regnode(char op)
 	*ptr++ = op;
 	*ptr++ = '\0';		/* Null "next" pointer. */
 	*ptr++ = '\0';
-	regcode = ptr;
+	cs->regcode = ptr;
 
 	return(ret);
 }
@@ -680,12 +687,12 @@ regnode(char op)
  - regc - emit (if appropriate) a byte of code
  */
 static void
-regc(char b)
+regc(regcomp_state *cs, char b)
 {
-	if (regcode != &regdummy)
-		*regcode++ = b;
+	if (cs->regcode != &cs->regdummy)
+		*cs->regcode++ = b;
 	else
-		regsize++;
+		cs->regsize++;
 }
 
 /*
@@ -694,20 +701,20 @@ regc(char b)
  * Means relocating the operand.
  */
 static void
-reginsert(char op, char *opnd)
+reginsert(regcomp_state *cs, char op, char *opnd)
 {
 	char *src;
 	char *dst;
 	char *place;
 
-	if (regcode == &regdummy) {
-		regsize += 3;
+	if (cs->regcode == &cs->regdummy) {
+		cs->regsize += 3;
 		return;
 	}
 
-	src = regcode;
-	regcode += 3;
-	dst = regcode;
+	src = cs->regcode;
+	cs->regcode += 3;
+	dst = cs->regcode;
 	while (src > opnd)
 		*--dst = *--src;
 
@@ -721,13 +728,13 @@ reginsert(char op, char *opnd)
  - regtail - set the next-pointer at the end of a node chain
  */
 static void
-regtail(char *p, char *val)
+regtail(regcomp_state *cs, char *p, char *val)
 {
 	char *scan;
 	char *temp;
 	int offset;
 
-	if (p == &regdummy)
+	if (p == &cs->regdummy)
 		return;
 
 	/* Find last node. */
@@ -751,12 +758,12 @@ regtail(char *p, char *val)
  - regoptail - regtail on operand of first argument; nop if operandless
  */
 static void
-regoptail(char *p, char *val)
+regoptail(regcomp_state *cs, char *p, char *val)
 {
 	/* "Operandless" and "op != BRANCH" are synonymous in practice. */
-	if (p == NULL || p == &regdummy || OP(p) != BRANCH)
+	if (p == NULL || p == &cs->regdummy || OP(p) != BRANCH)
 		return;
-	regtail(OPERAND(p), val);
+	regtail(cs, OPERAND(p), val);
 }
 
 /*
@@ -1138,9 +1145,7 @@ regnext(char *p)
 {
 	int offset;
 
-	if (p == &regdummy)
-		return(NULL);
-
+	/* The size counting pass of regcomp() never follows the chain */
 	offset = NEXT(p);
 	if (offset == 0)
 		return(NULL);
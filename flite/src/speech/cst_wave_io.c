@@ -142,6 +142,77 @@ int cst_wave_save_raw_fd(cst_wave *w, cst_file fd)
 }
 
 
+static void cst_wave_riff_header(cst_file fd, int sample_rate,
+				 int num_channels, int data_bytes)
+{
+    /* data_bytes of -1 marks a stream of unknown length */
+    const char *info;
+    short d_short;
+    int d_int;
+    int num_bytes;
+
+    info = "RIFF";
+    cst_fwrite(fd,info,4,1);
+    if (data_bytes < 0)
+	num_bytes = -1;
+    else
+	num_bytes = data_bytes + 8 + 16 + 12;
+    if (CST_BIG_ENDIAN) num_bytes = SWAPINT(num_bytes);
+    cst_fwrite(fd,&num_bytes,4,1); /* num bytes in whole file */
+    info = "WAVE";
+    cst_fwrite(fd,info,1,4);
+    info = "fmt ";
+    cst_fwrite(fd,info,1,4);
+    num_bytes = 16;                   /* size of header */
+    if (CST_BIG_ENDIAN) num_bytes = SWAPINT(num_bytes);
+    cst_fwrite(fd,&num_bytes,4,1);        
+    d_short = RIFF_FORMAT_PCM;        /* sample type */
+    if (CST_BIG_ENDIAN) d_short = SWAPSHORT(d_short);
+    cst_fwrite(fd,&d_short,2,1);          
+    d_short = num_channels;           /* number of channels */
+    if (CST_BIG_ENDIAN) d_short = SWAPSHORT(d_short);
+    cst_fwrite(fd,&d_short,2,1);          
+    d_int = sample_rate;              /* sample rate */
+    if (CST_BIG_ENDIAN) d_int = SWAPINT(d_int);
+    cst_fwrite(fd,&d_int,4,1);  
+    d_int = (sample_rate
+	     * num_channels
+	     * sizeof(short));        /* average bytes per second */
+    if (CST_BIG_ENDIAN) d_int = SWAPINT(d_int);
+    cst_fwrite(fd,&d_int,4,1);
+    d_short = (num_channels
+	       * sizeof(short));      /* block align */
+    if (CST_BIG_ENDIAN) d_short = SWAPSHORT(d_short);
+    cst_fwrite(fd,&d_short,2,1);          
+    d_short = 2 * 8;                  /* bits per sample */
+    if (CST_BIG_ENDIAN) d_short = SWAPSHORT(d_short);
+    cst_fwrite(fd,&d_short,2,1);          
+    info = "data";
+    cst_fwrite(fd,info,1,4);
+    d_int = data_bytes;               /* bytes in data */
+    if (CST_BIG_ENDIAN) d_int = SWAPINT(d_int);
+    cst_fwrite(fd,&d_int,4,1);  
+}
+
+static int cst_wave_riff_samples(cst_file fd, const short *samples, int n)
+{
+    /* riff samples are little endian */
+    int r;
+
+    if (CST_BIG_ENDIAN)
+    {
+	short *xdata = cst_alloc(short,n);
+	memmove(xdata,samples,sizeof(short)*n);
+	swap_bytes_short(xdata,n);
+	r = cst_fwrite(fd,xdata,sizeof(short),n);
+	cst_free(xdata);
+    }
+    else
+	r = cst_fwrite(fd,samples,sizeof(short),n);
+
+    return r;
+}
+
 int cst_wave_append_riff(cst_wave *w,const char *filename)
 {
     /* Appends to wave in file if it already exists */
@@ -175,25 +246,8 @@ int cst_wave_append_riff(cst_wave *w,const char *filename)
 	      (hdr.num_samples*hdr.num_channels*sizeof(short)),
 	      CST_SEEK_ABSOLUTE);
 
-    if (CST_BIG_ENDIAN)
-    {
-	short *xdata = cst_alloc(short,cst_wave_num_channels(w)*
-				 cst_wave_num_samples(w));
-	memmove(xdata,cst_wave_samples(w),
-		sizeof(short)*cst_wave_num_channels(w)*
-		cst_wave_num_samples(w));
-	swap_bytes_short(xdata,
-			 cst_wave_num_channels(w)*
-			 cst_wave_num_samples(w));
-	n = cst_fwrite(fd,xdata,sizeof(short),
-		       cst_wave_num_channels(w)*cst_wave_num_samples(w));
-	cst_free(xdata);
-    }
-    else
-    {
-	n = cst_fwrite(fd,cst_wave_samples(w),sizeof(short),
-		       cst_wave_num_channels(w)*cst_wave_num_samples(w));
-    }
+    n = cst_wave_riff_samples(fd,cst_wave_samples(w),
+			      cst_wave_num_channels(w)*cst_wave_num_samples(w));
 
     cst_fseek(fd,4,CST_SEEK_ABSOLUTE);
     num_bytes = hdr.num_bytes + (n*sizeof(short));
@@ -234,79 +288,129 @@ int cst_wave_save_riff(cst_wave *w,const char *filename)
 
 int cst_wave_save_riff_fd(cst_wave *w, cst_file fd)
 {
-    const char *info;
-    short d_short;
-    int d_int, n;
-    int num_bytes;
+    int n;
 
-    info = "RIFF";
-    cst_fwrite(fd,info,4,1);
-    num_bytes = (cst_wave_num_samples(w)
-		 * cst_wave_num_channels(w)
-		 * sizeof(short)) + 8 + 16 + 12;
-    if (CST_BIG_ENDIAN) num_bytes = SWAPINT(num_bytes);
-    cst_fwrite(fd,&num_bytes,4,1); /* num bytes in whole file */
-    info = "WAVE";
-    cst_fwrite(fd,info,1,4);
-    info = "fmt ";
-    cst_fwrite(fd,info,1,4);
-    num_bytes = 16;                   /* size of header */
-    if (CST_BIG_ENDIAN) num_bytes = SWAPINT(num_bytes);
-    cst_fwrite(fd,&num_bytes,4,1);        
-    d_short = RIFF_FORMAT_PCM;        /* sample type */
-    if (CST_BIG_ENDIAN) d_short = SWAPSHORT(d_short);
-    cst_fwrite(fd,&d_short,2,1);          
-    d_short = cst_wave_num_channels(w); /* number of channels */
-    if (CST_BIG_ENDIAN) d_short = SWAPSHORT(d_short);
-    cst_fwrite(fd,&d_short,2,1);          
-    d_int = cst_wave_sample_rate(w);  /* sample rate */
-    if (CST_BIG_ENDIAN) d_int = SWAPINT(d_int);
-    cst_fwrite(fd,&d_int,4,1);  
-    d_int = (cst_wave_sample_rate(w)
-	     * cst_wave_num_channels(w)
-	     * sizeof(short));        /* average bytes per second */
-    if (CST_BIG_ENDIAN) d_int = SWAPINT(d_int);
-    cst_fwrite(fd,&d_int,4,1);
-    d_short = (cst_wave_num_channels(w)
-	       * sizeof(short));      /* block align */
-    if (CST_BIG_ENDIAN) d_short = SWAPSHORT(d_short);
-    cst_fwrite(fd,&d_short,2,1);          
-    d_short = 2 * 8;                  /* bits per sample */
-    if (CST_BIG_ENDIAN) d_short = SWAPSHORT(d_short);
-    cst_fwrite(fd,&d_short,2,1);          
-    info = "data";
-    cst_fwrite(fd,info,1,4);
-    d_int = (cst_wave_num_channels(w)
-	     * cst_wave_num_samples(w)
-	     * sizeof(short));	      /* bytes in data */
-    if (CST_BIG_ENDIAN) d_int = SWAPINT(d_int);
-    cst_fwrite(fd,&d_int,4,1);  
+    cst_wave_riff_header(fd,cst_wave_sample_rate(w),cst_wave_num_channels(w),
+			 cst_wave_num_channels(w)*cst_wave_num_samples(w)*
+			 sizeof(short));
+    n = cst_wave_riff_samples(fd,cst_wave_samples(w),
+			      cst_wave_num_channels(w)*cst_wave_num_samples(w));
 
-    if (CST_BIG_ENDIAN)
-    {
-        short *xdata = cst_alloc(short,cst_wave_num_channels(w)*
-				 cst_wave_num_samples(w));
-	memmove(xdata,cst_wave_samples(w),
-		sizeof(short)*cst_wave_num_channels(w)*
-		cst_wave_num_samples(w));
-	swap_bytes_short(xdata,
-			 cst_wave_num_channels(w)*
-			 cst_wave_num_samples(w));
-	n = cst_fwrite(fd,xdata,sizeof(short),
-		       cst_wave_num_channels(w)*cst_wave_num_samples(w));
-	cst_free(xdata);
-    }
+    if (n != cst_wave_num_channels(w)*cst_wave_num_samples(w))
+	return -1;
+    else
+	return 0;
+	
+}
+
+/* A riff file written as it is synthesized: the file is opened once,   */
+/* samples are written as they come and the header's sizes are patched */
+/* when it is closed.  Where the file can't seek (a pipe, or "-" for   */
+/* stdout, even when redirected to a file, as the redirect may append   */
+/* or follow other output) the sizes are left as 0xffffffff, which most */
+/* readers take as "until the end of the stream"                        */
+cst_wave_stream *cst_wave_stream_open(const char *filename)
+{
+    cst_wave_stream *s;
+    cst_file fd;
+
+#ifndef UNDER_CE
+    if (cst_streq(filename,"-"))
+	fd = stdout;
     else
+#endif
+    if ((fd = cst_fopen(filename,CST_OPEN_WRITE|CST_OPEN_BINARY)) == NULL)
     {
-	n = cst_fwrite(fd,cst_wave_samples(w),sizeof(short),
-		       cst_wave_num_channels(w)*cst_wave_num_samples(w));
+	cst_errmsg("cst_wave_stream_open: can't open file \"%s\"\n",
+		   filename);
+	return NULL;
     }
 
-    if (n != cst_wave_num_channels(w)*cst_wave_num_samples(w))
+    s = cst_alloc(cst_wave_stream,1);
+    s->fd = fd;
+#ifndef UNDER_CE
+    s->is_stdout = (fd == stdout);
+#endif
+#ifndef UNDER_CE
+    if (s->is_stdout)
+	s->seekable = 0;
+    else
+#endif
+    s->seekable = (cst_ftell(fd) >= 0);
+    s->header_offset = 0;
+    s->header_written = 0;
+    s->num_samples = 0;
+
+    return s;
+}
+
+static void cst_wave_stream_header(cst_wave_stream *s, int sample_rate,
+				   int num_channels)
+{
+    s->sample_rate = sample_rate;
+    s->num_channels = num_channels;
+    if (s->seekable)
+	s->header_offset = cst_ftell(s->fd);
+    /* unknown until close, so a file cut short is still readable */
+    cst_wave_riff_header(s->fd,sample_rate,num_channels,-1);
+    s->header_written = 1;
+}
+
+int cst_wave_stream_write(cst_wave_stream *s, const cst_wave *w,
+			  int start, int size)
+{
+    int n;
+
+    if (!s->header_written)
+	cst_wave_stream_header(s,cst_wave_sample_rate(w),
+			       cst_wave_num_channels(w));
+    if (size <= 0)
+	return 0;
+
+    n = cst_wave_riff_samples(s->fd,
+			      cst_wave_samples(w)+(start*cst_wave_num_channels(w)),
+			      size*cst_wave_num_channels(w));
+    s->num_samples += n;
+
+    if (n != size*cst_wave_num_channels(w))
 	return -1;
     else
 	return 0;
-	
+}
+
+int cst_wave_stream_close(cst_wave_stream *s)
+{
+    int num_bytes;
+    int rv = 0;
+
+    if (s == NULL)
+	return 0;
+    if (!s->header_written)   /* nothing synthesized, still a valid file */
+	cst_wave_stream_header(s,16000,1);
+
+    if (s->seekable)
+    {
+	num_bytes = (s->num_samples * sizeof(short)) + 8 + 16 + 12;
+	if (CST_BIG_ENDIAN) num_bytes = SWAPINT(num_bytes);
+	cst_fseek(s->fd,s->header_offset+4,CST_SEEK_ABSOLUTE);
+	cst_fwrite(s->fd,&num_bytes,4,1); /* num bytes in whole file */
+	num_bytes = s->num_samples * sizeof(short);
+	if (CST_BIG_ENDIAN) num_bytes = SWAPINT(num_bytes);
+	cst_fseek(s->fd,s->header_offset+4+4+4+4+4+2+2+4+4+2+2+4,
+		  CST_SEEK_ABSOLUTE);
+	if (cst_fwrite(s->fd,&num_bytes,4,1) != 1)   /* num bytes in data */
+	    rv = -1;
+    }
+
+#ifndef UNDER_CE
+    if (s->is_stdout)
+	fflush(stdout);
+    else
+#endif
+    cst_fclose(s->fd);
+    cst_free(s);
+
+    return rv;
 }
 
 int cst_wave_load_raw(cst_wave *w,const char *filename,
@@ -44,6 +44,13 @@
 #include "cst_clunits.h"
 #include "cst_cg.h"
 
+/* Long texts are synthesized by several threads where there are pthreads */
+#if !defined(CST_NO_THREADS) && !defined(_WIN32) && !defined(UNDER_CE) && \
+    !defined(__palmos__)
+#define FLITE_PTHREADS
+#include <pthread.h>
+#endif
+
 #ifdef WIN32
 /* For Visual Studio 2012 global variable definitions */
 #define GLOBALVARDEF __declspec(dllexport)
@@ -246,6 +253,62 @@ cst_wave *flite_text_to_wave(const char *text, cst_voice *voice)
     return w;
 }
 
+flite_context *new_flite_context(cst_voice *voice)
+{
+    flite_context *c;
+
+    c = cst_alloc(flite_context,1);
+    c->voice = voice;
+    c->features = new_features();
+    feat_link_into(voice->features,c->features);
+
+    return c;
+}
+
+void delete_flite_context(flite_context *c)
+{
+    if (c)
+    {
+        delete_features(c->features);
+        cst_free(c);
+    }
+}
+
+cst_utterance *flite_context_synth_text(flite_context *c, const char *text)
+{
+    cst_utterance *u;
+
+    u = new_utterance();
+    utt_set_input_text(u,text);
+
+    /* As utt_init(), but the utterance's features fall back to the */
+    /* context's, which fall back to the voice's                    */
+    feat_link_into(c->features,u->features);
+    feat_link_into(c->voice->ffunctions,u->ffunctions);
+    if (c->voice->utt_init)
+	c->voice->utt_init(u, c->voice);
+
+    if (utt_synth(u) == NULL)
+    {
+	delete_utterance(u);
+	return NULL;
+    }
+    return u;
+}
+
+cst_wave *flite_context_text_to_wave(flite_context *c, const char *text)
+{
+    cst_utterance *u;
+    cst_wave *w;
+
+    if ((u = flite_context_synth_text(c,text)) == NULL)
+	return NULL;
+
+    w = copy_wave(utt_wave(u));
+    delete_utterance(u);
+    return w;
+}
+
 float flite_file_to_speech(const char *filename, 
 			   cst_voice *voice,
 			   const char *outtype)
@@ -267,94 +330,336 @@ float flite_file_to_speech(const char *filename,
 }
 
 
+/* Splits a token stream into utterances at the voice's breaks */
+typedef struct flite_ts_reader_struct {
+    cst_tokenstream *ts;
+    cst_breakfunc breakfunc;
+    cst_utterance *utt;         /* the utterance being filled */
+    cst_relation *tokrel;
+    int num_tokens;
+} flite_ts_reader;
+
+static void ts_reader_new_utt(flite_ts_reader *r)
+{
+    r->utt = new_utterance();
+    r->tokrel = utt_relation_create(r->utt, "Token");
+    r->num_tokens = 0;
+}
+
+static void ts_reader_add_token(flite_ts_reader *r, const char *token)
+{
+    cst_tokenstream *ts = r->ts;
+    cst_item *t;
+
+    r->num_tokens++;
+
+    t = relation_append(r->tokrel, NULL);
+    item_set_string(t,"name",token);
+    item_set_string(t,"whitespace",ts->whitespace);
+    item_set_string(t,"prepunctuation",ts->prepunctuation);
+    item_set_string(t,"punc",ts->postpunctuation);
+    /* Mark it at the beginning of the token */
+    item_set_int(t,"file_pos",
+                 ts->file_pos-(1+ /* as we are already on the next char */
+                               cst_strlen(token)+
+                               cst_strlen(ts->prepunctuation)+
+                               cst_strlen(ts->postpunctuation)));
+    item_set_int(t,"line_number",ts->line_number);
+}
+
+/* Returns the next complete utterance, or NULL at the end of the stream */
+static cst_utterance *ts_reader_next(flite_ts_reader *r)
+{
+    const char *token;
+    cst_utterance *utt;
+
+    while (!ts_eof(r->ts) || r->num_tokens > 0)
+    {
+	token = ts_get(r->ts);
+	if ((cst_strlen(token) == 0) ||
+	    (r->num_tokens > 500) ||  /* need an upper bound */
+	    (relation_head(r->tokrel) && 
+	     r->breakfunc(r->ts,token,r->tokrel)))
+	{
+	    /* An end of utt, the token starts the next one */
+	    utt = r->utt;
+	    r->utt = NULL;
+	    r->num_tokens = 0;
+	    if (!ts_eof(r->ts))
+	    {
+		ts_reader_new_utt(r);
+		ts_reader_add_token(r,token);
+	    }
+	    return utt;
+	}
+	ts_reader_add_token(r,token);
+    }
+
+    return NULL;
+}
+
+/* Outputs an utterance synthesized from a token stream, into the open */
+/* wave file if writing to one                                        */
+static float ts_output(cst_utterance *u, const char *outtype,
+                       cst_wave_stream *ws)
+{
+    cst_wave *w;
+
+    if (ws == NULL)
+        return flite_process_output(u,outtype,TRUE);
+
+    w = utt_wave(u);
+    cst_wave_stream_write(ws,w,0,cst_wave_num_samples(w));
+
+    return (float)w->num_samples/(float)w->sample_rate;
+}
+
+#ifdef FLITE_PTHREADS
+/* Utterances are synthesized by a pool of threads, while this thread */
+/* reads ahead and outputs the synthesized ones in order              */
+typedef struct flite_ts_pool_struct {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    cst_voice *voice;
+    const char *outtype;
+    cst_wave_stream *ws;        /* the file being written, if any */
+    int num_slots;              /* utterances in flight */
+    cst_utterance **utts;       /* by utterance number modulo num_slots */
+    int *done;
+    int next_in;                /* number of the next utterance queued */
+    int next_synth;             /* ... synthesized */
+    int next_out;               /* ... output */
+    int finished;               /* nothing more will be queued */
+    int stopping;               /* don't synthesize the rest */
+} flite_ts_pool;
+
+static void *ts_pool_worker(void *arg)
+{
+    flite_ts_pool *p = arg;
+    cst_utterance *u;
+    int slot, stopping;
+
+    pthread_mutex_lock(&p->lock);
+    while (1)
+    {
+        while ((p->next_synth == p->next_in) && !p->finished)
+            pthread_cond_wait(&p->changed,&p->lock);
+        if (p->next_synth == p->next_in)
+            break;
+
+        slot = p->next_synth % p->num_slots;
+        p->next_synth++;
+        u = p->utts[slot];
+        stopping = p->stopping;
+        pthread_mutex_unlock(&p->lock);
+
+        if (!stopping)
+            u = flite_do_synth(u,p->voice,utt_synth_tokens);
+
+        pthread_mutex_lock(&p->lock);
+        p->utts[slot] = u;
+        p->done[slot] = 1;
+        pthread_cond_broadcast(&p->changed);
+    }
+    pthread_mutex_unlock(&p->lock);
+
+    return NULL;
+}
+
+/* Outputs the synthesized utterances that are next in order, waiting */
+/* for the next one first if asked to, adding up their durations      */
+static void ts_pool_output(flite_ts_pool *p, int wait, float *durs)
+{
+    cst_utterance *u;
+    int slot, stopping;
+
+    pthread_mutex_lock(&p->lock);
+    if (wait)
+        while (!p->done[p->next_out % p->num_slots])
+            pthread_cond_wait(&p->changed,&p->lock);
+
+    while ((p->next_out < p->next_in) &&
+           p->done[p->next_out % p->num_slots])
+    {
+        slot = p->next_out % p->num_slots;
+        u = p->utts[slot];
+        p->utts[slot] = NULL;
+        p->done[slot] = 0;
+        p->next_out++;
+        stopping = p->stopping;
+        pthread_mutex_unlock(&p->lock);
+
+        if (u && !stopping && feat_present(u->features,"Interrupted"))
+        {
+            pthread_mutex_lock(&p->lock);
+            p->stopping = stopping = 1;
+            pthread_mutex_unlock(&p->lock);
+        }
+        if (u && !stopping)
+            *durs += ts_output(u,p->outtype,p->ws);
+        if (u)
+            delete_utterance(u);
+
+        pthread_mutex_lock(&p->lock);
+        pthread_cond_broadcast(&p->changed);
+    }
+    pthread_mutex_unlock(&p->lock);
+}
+
+static float ts_to_speech_parallel(flite_ts_reader *r,
+                                   cst_voice *voice,
+                                   const char *outtype,
+                                   cst_wave_stream *ws,
+                                   cst_uttfunc utt_user_callback,
+                                   int num_threads)
+{
+    flite_ts_pool p;
+    pthread_t *threads;
+    cst_utterance *utt;
+    float durs = 0;
+    int i, started;
+
+    pthread_mutex_init(&p.lock,NULL);
+    pthread_cond_init(&p.changed,NULL);
+    p.voice = voice;
+    p.outtype = outtype;
+    p.ws = ws;
+    p.num_slots = num_threads * 2;
+    p.utts = cst_alloc(cst_utterance *,p.num_slots);
+    p.done = cst_alloc(int,p.num_slots);
+    p.next_in = p.next_synth = p.next_out = 0;
+    p.finished = p.stopping = 0;
+
+    threads = cst_alloc(pthread_t,num_threads);
+    for (started=0; started < num_threads; started++)
+        if (pthread_create(&threads[started],NULL,ts_pool_worker,&p) != 0)
+            break;
+
+    if (started > 0)
+    {
+        while ((utt = ts_reader_next(r)) != NULL)
+        {
+            if (utt_user_callback)
+                utt = (utt_user_callback)(utt);
+            if (utt == NULL)
+                break;
+
+            /* Wait for a free slot, outputting in order */
+            while (p.next_in - p.next_out == p.num_slots)
+                ts_pool_output(&p,TRUE,&durs);
+
+            pthread_mutex_lock(&p.lock);
+            if (p.stopping)
+            {
+                pthread_mutex_unlock(&p.lock);
+                delete_utterance(utt);
+                break;
+            }
+            p.utts[p.next_in % p.num_slots] = utt;
+            p.next_in++;
+            pthread_cond_broadcast(&p.changed);
+            pthread_mutex_unlock(&p.lock);
+
+            ts_pool_output(&p,FALSE,&durs);
+        }
+    }
+
+    pthread_mutex_lock(&p.lock);
+    p.finished = 1;
+    pthread_cond_broadcast(&p.changed);
+    pthread_mutex_unlock(&p.lock);
+
+    while (p.next_out < p.next_in)
+        ts_pool_output(&p,TRUE,&durs);
+
+    for (i=0; i < started; i++)
+        pthread_join(threads[i],NULL);
+
+    cst_free(threads);
+    cst_free(p.utts);
+    cst_free(p.done);
+    pthread_cond_destroy(&p.changed);
+    pthread_mutex_destroy(&p.lock);
+
+    return durs;
+}
+#endif
+
 float flite_ts_to_speech(cst_tokenstream *ts,
                          cst_voice *voice,
                          const char *outtype)
 {
     cst_utterance *utt;
-    const char *token;
-    cst_item *t;
-    cst_relation *tokrel;
+    flite_ts_reader r;
     float durs = 0;
-    int num_tokens;
-    cst_wave *w;
-    cst_breakfunc breakfunc = default_utt_break;
+    cst_wave_stream *ws = NULL;
     cst_uttfunc utt_user_callback = 0;
-    int fp;
+    int fp, num_threads;
+
+    r.ts = ts;
+    r.breakfunc = default_utt_break;
 
     fp = get_param_int(voice->features,"file_start_position",0);
     if (fp > 0)
         ts_set_stream_pos(ts,fp);
     if (feat_present(voice->features,"utt_break"))
-	breakfunc = val_breakfunc(feat_val(voice->features,"utt_break"));
+	r.breakfunc = val_breakfunc(feat_val(voice->features,"utt_break"));
 
     if (feat_present(voice->features,"utt_user_callback"))
 	utt_user_callback = val_uttfunc(feat_val(voice->features,"utt_user_callback"));
 
-    /* If its a file to write to, create and save an empty wave file */
-    /* as we are going to incrementally append to it                 */
+    /* Threads synthesizing utterances ahead of the output, streamed */
+    /* output is played as it is synthesized so it must be serial,    */
+    /* as must anything given to a streaming callback                  */
+    num_threads = get_param_int(voice->features,"synth_threads",1);
+    if (cst_streq(outtype,"stream") ||
+        feat_present(voice->features,"streaming_info"))
+        num_threads = 1;
+
+    /* If its a file to write to, keep it open and write each utterance */
+    /* to it as it is synthesized, the header is finished at the end    */
     if (!cst_streq(outtype,"play") && 
         !cst_streq(outtype,"none") &&
         !cst_streq(outtype,"stream"))
     {
-	w = new_wave();
-	cst_wave_resize(w,0,1);
-	cst_wave_set_sample_rate(w,16000);
-	cst_wave_save_riff(w,outtype);  /* an empty wave */
-	delete_wave(w);
+        ws = cst_wave_stream_open(outtype);
+        if (ws == NULL)
+        {
+            ts_close(ts);
+            return durs;
+        }
     }
 
-    num_tokens = 0;
-    utt = new_utterance();
-    tokrel = utt_relation_create(utt, "Token");
-    while (!ts_eof(ts) || num_tokens > 0)
-    {
-	token = ts_get(ts);
-	if ((cst_strlen(token) == 0) ||
-	    (num_tokens > 500) ||  /* need an upper bound */
-	    (relation_head(tokrel) && 
-	     breakfunc(ts,token,tokrel)))
-	{
-	    /* An end of utt, so synthesize it */
-            if (utt_user_callback)
-                utt = (utt_user_callback)(utt);
-
-            if (utt)
-            {
-                utt = flite_do_synth(utt,voice,utt_synth_tokens);
-                if (feat_present(utt->features,"Interrupted"))
-                {
-                    delete_utterance(utt); utt = NULL;
-                    break;
-                }
-                durs += flite_process_output(utt,outtype,TRUE);
-                delete_utterance(utt); utt = NULL;
-            }
-            else 
-                break;
+    ts_reader_new_utt(&r);
 
-	    if (ts_eof(ts)) break;
+#ifdef FLITE_PTHREADS
+    if (num_threads > 1)
+        durs = ts_to_speech_parallel(&r,voice,outtype,ws,utt_user_callback,
+                                     num_threads);
+    else
+#endif
+    while ((utt = ts_reader_next(&r)) != NULL)
+    {
+        /* An end of utt, so synthesize it */
+        if (utt_user_callback)
+            utt = (utt_user_callback)(utt);
+        if (utt == NULL)
+            break;
 
-	    utt = new_utterance();
-	    tokrel = utt_relation_create(utt, "Token");
-	    num_tokens = 0;
-	}
-	num_tokens++;
-
-	t = relation_append(tokrel, NULL);
-	item_set_string(t,"name",token);
-	item_set_string(t,"whitespace",ts->whitespace);
-	item_set_string(t,"prepunctuation",ts->prepunctuation);
-	item_set_string(t,"punc",ts->postpunctuation);
-        /* Mark it at the beginning of the token */
-	item_set_int(t,"file_pos",
-                     ts->file_pos-(1+ /* as we are already on the next char */
-                                   cst_strlen(token)+
-                                   cst_strlen(ts->prepunctuation)+
-                                   cst_strlen(ts->postpunctuation)));
-	item_set_int(t,"line_number",ts->line_number);
+        utt = flite_do_synth(utt,voice,utt_synth_tokens);
+        if (utt == NULL)
+            continue;
+        if (feat_present(utt->features,"Interrupted"))
+        {
+            delete_utterance(utt);
+            break;
+        }
+        durs += ts_output(utt,outtype,ws);
+        delete_utterance(utt);
     }
-    if (utt) delete_utterance(utt);
+
+    if (r.utt) delete_utterance(r.utt);
+    cst_wave_stream_close(ws);
     ts_close(ts);
     return durs;
 }
@@ -392,6 +697,7 @@ float flite_process_output(cst_utterance *u, const char *outtype,
 {
     /* Play or save (append) output to output file */
     cst_wave *w;
+    cst_wave_stream *ws;
     float dur;
 
     if (!u) return 0.0;
@@ -411,8 +717,11 @@ float flite_process_output(cst_utterance *u, const char *outtype,
     {
         if (append)
             cst_wave_append_riff(w,outtype);
-        else
-            cst_wave_save_riff(w,outtype);
+        else if ((ws = cst_wave_stream_open(outtype)) != NULL)
+        {   /* as a stream so "-" is stdout */
+            cst_wave_stream_write(ws,w,0,cst_wave_num_samples(w));
+            cst_wave_stream_close(ws);
+        }
     }
 
     return dur;
@@ -70,7 +70,7 @@ int cst_errmsg(const char *fmt, ...)
 #endif
     return 0;
 }
-jmp_buf *cst_errjmp = 0;
+CST_THREAD_LOCAL jmp_buf *cst_errjmp = 0;
 
 #elif defined(__palmos__)
 #ifdef __ARM_ARCH_4T__
@@ -92,7 +92,7 @@ int cst_errmsg(const char *fmt, ...)
 #else
 
 #ifndef WASM32_WASI
-jmp_buf *cst_errjmp = 0;
+CST_THREAD_LOCAL jmp_buf *cst_errjmp = 0;
 #endif
 
 int cst_errmsg(const char *fmt, ...)
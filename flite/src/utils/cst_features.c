@@ -43,22 +43,149 @@
 
 CST_VAL_REGISTER_TYPE(features,cst_features)
 
-static cst_featvalpair *feat_find_featpair(const cst_features *f, 
-					   const char *name)
+/* Feature names are interned into symbols shared by every feature set. */
+/* Lookups don't take the lock: symbols are pushed onto the front of    */
+/* their bucket fully built, and are never freed, as feature names come */
+/* from a small vocabulary                                              */
+#if !defined(CST_NO_THREADS) && !defined(_WIN32) && !defined(UNDER_CE) && \
+    !defined(__palmos__)
+#include <pthread.h>
+static pthread_mutex_t feat_sym_lock = PTHREAD_MUTEX_INITIALIZER;
+#define feat_sym_lock() pthread_mutex_lock(&feat_sym_lock)
+#define feat_sym_unlock() pthread_mutex_unlock(&feat_sym_lock)
+#else
+#define feat_sym_lock()
+#define feat_sym_unlock()
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define feat_sym_load(P) __atomic_load_n(P,__ATOMIC_ACQUIRE)
+#define feat_sym_store(P,V) __atomic_store_n(P,V,__ATOMIC_RELEASE)
+#else
+#define feat_sym_load(P) (*(P))
+#define feat_sym_store(P,V) (*(P) = (V))
+#endif
+
+#define FEAT_SYM_BUCKETS 512
+static cst_feat_sym *feat_syms[FEAT_SYM_BUCKETS];
+
+/* Sets with up to this many features are just searched as a list */
+#define FEAT_LIST_MAX 8
+
+static unsigned int feat_hash(const char *name)
+{
+    unsigned int h = 2166136261u;
+
+    for ( ; *name; name++)
+        h = (h ^ (unsigned char)*name) * 16777619u;
+    return h;
+}
+
+static const cst_feat_sym *feat_sym_find(const char *name, unsigned int h)
+{
+    const cst_feat_sym *s;
+
+    for (s = feat_sym_load(&feat_syms[h % FEAT_SYM_BUCKETS]); s; s=s->next)
+        if ((s->hash == h) && cst_streq(name,s->name))
+            return s;
+    return NULL;
+}
+
+const cst_feat_sym *feat_sym(const char *name)
+{
+    return feat_sym_find(name,feat_hash(name));
+}
+
+const cst_feat_sym *feat_intern(const char *name)
+{
+    const cst_feat_sym *s;
+    cst_feat_sym *ns;
+    unsigned int h = feat_hash(name);
+
+    if ((s = feat_sym_find(name,h)) != NULL)
+        return s;
+
+    feat_sym_lock();
+    if ((s = feat_sym_find(name,h)) == NULL)
+    {
+        ns = cst_alloc(cst_feat_sym,1);
+        ns->name = cst_strdup(name);
+        ns->hash = h;
+        ns->next = feat_syms[h % FEAT_SYM_BUCKETS];
+        feat_sym_store(&feat_syms[h % FEAT_SYM_BUCKETS],ns);
+        s = ns;
+    }
+    feat_sym_unlock();
+
+    return s;
+}
+
+static void feat_table_add(cst_features *f, cst_featvalpair *p)
+{
+    int i;
+
+    for (i = p->sym->hash & (f->table_size-1); 
+         f->table[i]; 
+         i = (i+1) & (f->table_size-1));
+    f->table[i] = p;
+}
+
+static void feat_table_rebuild(cst_features *f)
+{
+    cst_featvalpair *p;
+
+    if (f->table)
+        cst_local_free(f->ctx,f->table);
+    f->table = NULL;
+    f->table_size = 0;
+
+    if (f->count > FEAT_LIST_MAX)
+    {   /* keep it at most half full */
+        for (f->table_size = 16; f->table_size < f->count*2; )
+            f->table_size *= 2;
+        f->table = (cst_featvalpair **)
+            cst_local_alloc(f->ctx,f->table_size*sizeof(cst_featvalpair *));
+        for (p=f->head; p; p=p->next)
+            feat_table_add(f,p);
+    }
+}
+
+static cst_featvalpair *feat_find_sym(const cst_features *f, 
+                                      const cst_feat_sym *s)
 {
     cst_featvalpair *n;
-    
-    if (f == NULL)
-	return NULL;
+    int i;
+
+    if ((f == NULL) || (s == NULL))
+        return NULL;
+    else if (f->table)
+    {
+        for (i = s->hash & (f->table_size-1); 
+             (n = f->table[i]) != NULL; 
+             i = (i+1) & (f->table_size-1))
+            if (n->sym == s)
+                return n;
+        return NULL;
+    }
     else
     {
 	for (n=f->head; n; n=n->next)
-	    if (cst_streq(name,n->name))
+	    if (n->sym == s)
 		return n;
 	return NULL;
     }
 }
 
+static cst_featvalpair *feat_find_featpair(const cst_features *f, 
+					   const char *name)
+{
+    if (f == NULL)
+	return NULL;
+    else
+        /* A name that was never interned can't be set anywhere */
+        return feat_find_sym(f,feat_sym(name));
+}
+
 cst_features *new_features(void)
 {
     cst_features *f;
@@ -91,6 +218,8 @@ void delete_features(cst_features *f)
 	    delete_val(n->val);
 	    cst_local_free(f->ctx,n);
 	}
+        if (f->table)
+            cst_local_free(f->ctx,f->table);
         delete_val(f->owned_strings);
 	cst_local_free(f->ctx,f);
     }
@@ -108,26 +237,25 @@ int feat_present(const cst_features *f, const char *name)
 
 int feat_length(const cst_features *f)
 {
-    int i=0;
-    cst_featvalpair *p;
     if (f)
-	for (i=0,p=f->head; p; p=p->next)
-	    i++;
-    return i;
+        return f->count;
+    else
+        return 0;
 }
 
 int feat_remove(cst_features *f, const char *name)
 {
     cst_featvalpair *n,*p,*np;
+    const cst_feat_sym *s;
     
-    if (f == NULL)
+    if ((f == NULL) || ((s = feat_sym(name)) == NULL))
 	return FALSE; /* didn't remove it */
     else
     {
 	for (p=NULL,n=f->head; n; p=n,n=np)
 	{
 	    np = n->next;
-	    if (cst_streq(name,n->name))
+	    if (n->sym == s)
 	    {
 		if (p == 0)
 		    f->head = np;
@@ -135,6 +263,9 @@ int feat_remove(cst_features *f, const char *name)
 		    p->next = np;
 		delete_val(n->val);
 		cst_local_free(f->ctx,n);
+                f->count--;
+                if (f->table)
+                    feat_table_rebuild(f);
 		return TRUE;
 	    }
 	}
@@ -158,16 +289,24 @@ const char *feat_string(const cst_features *f, const char *name)
 }
 
 const cst_val *feat_val(const cst_features *f, const char *name)
+{
+    if (f == NULL)
+        return NULL;
+    else
+        return feat_val_sym(f,feat_sym(name));
+}
+
+const cst_val *feat_val_sym(const cst_features *f, const cst_feat_sym *s)
 {
     cst_featvalpair *n;
-    n = feat_find_featpair(f,name);
+    n = feat_find_sym(f,s);
 
     if (n == NULL)
     {
         if (f && f->linked)
         {   /* Search the linked features too if there are any */
             /* We assume the linked features haven't been deleted, and */
-            return feat_val(f->linked,name);
+            return feat_val_sym(f->linked,s);
         }
         else
             return NULL; /* its really not there at all */
@@ -235,23 +374,40 @@ void feat_set_string(cst_features *f, const char *name, const char *v)
 }
 
 void feat_set(cst_features *f, const char* name, const cst_val *val)
+{
+    if (val == NULL)
+    {
+	cst_errmsg("cst_features: trying to set a NULL val for feature \"%s\"\n",
+		   name);
+    }
+    else
+        feat_set_sym(f,feat_intern(name),val);
+}
+
+void feat_set_sym(cst_features *f, const cst_feat_sym *s, const cst_val *val)
 {
     cst_featvalpair *n;
-    n = feat_find_featpair(f,name);
+    n = feat_find_sym(f,s);
 
     if (val == NULL)
     {
 	cst_errmsg("cst_features: trying to set a NULL val for feature \"%s\"\n",
-		   name);
+		   s->name);
     }
     else if (n == NULL)
     {   /* first reference to this feature so create new fpair */
 	cst_featvalpair *p;
 	p = (cst_featvalpair *)cst_local_alloc(f->ctx, sizeof(*p));
 	p->next = f->head;
-        p->name = name;
+        p->name = s->name;
+        p->sym = s;
 	p->val = val_inc_refcount(val);
 	f->head = p;
+        f->count++;
+        if (f->table && (f->count*2 <= f->table_size))
+            feat_table_add(f,p);
+        else if (f->count > FEAT_LIST_MAX)
+            feat_table_rebuild(f);
     }
     else
     {
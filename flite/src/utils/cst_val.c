@@ -48,18 +48,63 @@ static cst_val *new_val()
     return cst_alloc(struct cst_val_struct,1);
 }
 
+/* Immediate ints and floats: with 64 bit pointers the value is in the */
+/* top 32 bits, with 32 bit pointers ints must fit in 30 bits and      */
+/* floats must have their bottom two mantissa bits clear, anything     */
+/* else gets a cell                                                    */
+static int val_immediate_int(const cst_val *v)
+{
+#if UINTPTR_MAX > 0xfffffffful
+    return (int)(unsigned int)(((uintptr_t)v) >> 32);
+#else
+    return ((int)(uintptr_t)v) >> 2;
+#endif
+}
+
+static float val_immediate_float(const cst_val *v)
+{
+    union { float f; uint32_t u; } b;
+
+#if UINTPTR_MAX > 0xfffffffful
+    b.u = (uint32_t)(((uintptr_t)v) >> 32);
+#else
+    b.u = ((uint32_t)(uintptr_t)v) & ~(uint32_t)3;
+#endif
+    return b.f;
+}
+
 cst_val *int_val(int i)
 {
-    cst_val *v = new_val();
-    CST_VAL_TYPE(v) = CST_VAL_TYPE_INT;
+    cst_val *v;
+
+#if UINTPTR_MAX > 0xfffffffful
+    return (cst_val *)((((uintptr_t)(unsigned int)i) << 32) | 
+                       CST_VAL_TYPE_INT);
+#else
+    if ((i >= -(1<<29)) && (i < (1<<29)))
+        return (cst_val *)((((uintptr_t)(unsigned int)i) << 2) | 
+                           CST_VAL_TYPE_INT);
+#endif
+    v = new_val();
+    CST_VAL_CELL_TYPE(v) = CST_VAL_TYPE_INT;
     CST_VAL_INT(v) = i;
     return v;
 }
     
 cst_val *float_val(float f)
 {
-    cst_val *v = new_val();
-    CST_VAL_TYPE(v) = CST_VAL_TYPE_FLOAT;
+    cst_val *v;
+    union { float f; uint32_t u; } b;
+
+    b.f = f;
+#if UINTPTR_MAX > 0xfffffffful
+    return (cst_val *)((((uintptr_t)b.u) << 32) | CST_VAL_TYPE_FLOAT);
+#else
+    if ((b.u & 3) == 0)
+        return (cst_val *)(((uintptr_t)b.u) | CST_VAL_TYPE_FLOAT);
+#endif
+    v = new_val();
+    CST_VAL_CELL_TYPE(v) = CST_VAL_TYPE_FLOAT;
     CST_VAL_FLOAT(v) = f;
     return v;
 }
@@ -67,7 +112,7 @@ cst_val *float_val(float f)
 cst_val *string_val(const char *s)
 {
     cst_val *v = new_val();
-    CST_VAL_TYPE(v) = CST_VAL_TYPE_STRING;
+    CST_VAL_CELL_TYPE(v) = CST_VAL_TYPE_STRING;
     /* would be nice to note if this is a deletable string or not */
     CST_VAL_STRING_LVAL(v) = cst_strdup(s);
     return v;
@@ -86,7 +131,7 @@ cst_val *cons_val(const cst_val *a, const cst_val *b)
 cst_val *val_new_typed(int type,void *vv)
 {
     cst_val *v = new_val();
-    CST_VAL_TYPE(v) = type;
+    CST_VAL_CELL_TYPE(v) = type;
     CST_VAL_VOID(v) = vv;
     return v;
 }
@@ -133,7 +178,14 @@ void delete_val(cst_val *v)
 /* Accessor functions */
 int val_int(const cst_val *v)
 {
-    if (v && (CST_VAL_TYPE(v) == CST_VAL_TYPE_INT))
+    if (CST_VAL_IMMEDIATE(v))
+    {
+        if (CST_VAL_TYPE(v) == CST_VAL_TYPE_INT)
+            return val_immediate_int(v);
+        else
+            return (int)val_immediate_float(v);
+    }
+    else if (v && (CST_VAL_TYPE(v) == CST_VAL_TYPE_INT))
 	return CST_VAL_INT(v);
     else if (v && (CST_VAL_TYPE(v) == CST_VAL_TYPE_FLOAT))
 	return (int)CST_VAL_FLOAT(v);
@@ -150,7 +202,14 @@ int val_int(const cst_val *v)
 
 float val_float(const cst_val *v)
 {
-    if (v && (CST_VAL_TYPE(v) == CST_VAL_TYPE_INT))
+    if (CST_VAL_IMMEDIATE(v))
+    {
+        if (CST_VAL_TYPE(v) == CST_VAL_TYPE_INT)
+            return (float)val_immediate_int(v);
+        else
+            return val_immediate_float(v);
+    }
+    else if (v && (CST_VAL_TYPE(v) == CST_VAL_TYPE_INT))
 	return (float)CST_VAL_INT(v);
     else if (v && (CST_VAL_TYPE(v) == CST_VAL_TYPE_FLOAT))
 	return CST_VAL_FLOAT(v);
@@ -256,6 +315,8 @@ int cst_val_consp(const cst_val *v)
 #endif
     const cst_val_atom *t;
 
+    if (CST_VAL_IMMEDIATE(v))
+        return FALSE;
     t = (const cst_val_atom *)v;
     if (t->type % 2 == 0)
       return TRUE;
@@ -434,6 +495,15 @@ int val_member_string(const char *v1,const cst_val *l)
     return FALSE;
 }
 
+/* Vals in a voice are shared by every thread synthesizing with that */
+/* voice, so their reference counts are changed atomically           */
+#if defined(__GNUC__) || defined(__clang__)
+#define val_refcount_add(X,N) \
+    __atomic_add_fetch(&CST_VAL_REFCOUNT(X),N,__ATOMIC_ACQ_REL)
+#else
+#define val_refcount_add(X,N) (CST_VAL_REFCOUNT(X) += (N))
+#endif
+
 cst_val *val_inc_refcount(const cst_val *b)
 {
     cst_val *wb;
@@ -442,11 +512,11 @@ cst_val *val_inc_refcount(const cst_val *b)
     /* where breaking const is reasonable                              */
     wb = (cst_val *)(void *)b;
 
-    if (CST_VAL_REFCOUNT(wb) == -1) 
+    if (CST_VAL_IMMEDIATE(wb) || (CST_VAL_REFCOUNT(wb) == -1))
 	/* or is a cons cell in the text segment, how do I do that ? */
 	return wb;
     else if (!cst_val_consp(wb)) /* we don't ref count cons cells */
-	CST_VAL_REFCOUNT(wb) += 1;
+	val_refcount_add(wb,1);
     return wb;
 }
 
@@ -456,7 +526,7 @@ int val_dec_refcount(const cst_val *b)
 
     wb = (cst_val *)(void *)b;
 
-    if (CST_VAL_REFCOUNT(wb) == -1) 
+    if (CST_VAL_IMMEDIATE(wb) || (CST_VAL_REFCOUNT(wb) == -1))
 	/* or is a cons cell in the text segment, how do I do that ? */
 	return -1;
     else if (cst_val_consp(wb)) /* we don't ref count cons cells */
@@ -469,10 +539,7 @@ int val_dec_refcount(const cst_val *b)
 	return 0;
     }
     else
-    {
-	CST_VAL_REFCOUNT(wb) -= 1;
-	return 	CST_VAL_REFCOUNT(wb);
-    }
+	return val_refcount_add(wb,-1);
 }
 
 #ifdef _WIN32
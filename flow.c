@@ -2,17 +2,22 @@
 #include <ctype.h>
 #include <pthread.h>
 #include <signal.h>
+#include <SDL.h>
 
 #include "flite/include/flite.h"
+#include "pronounce.h"
+#include "render.h"
+#include "speech.h"
 
 cst_voice *flite_voice;
 int initializing_flite = 0;
 
-extern char screenbuffer[24][40];
-extern char selection_buffer[24][40];
+// The focused device's screen, copied from the renderer for each announcement
+static char screenbuffer[24][40];
+static char selection_buffer[24][40];
 
 int selection_row;
-extern int new_selection_row;
+static int new_selection_row = -1;
 int selection_column;
 
 char current_page[40];
@@ -26,7 +31,7 @@ int currently_speaking = 0;
 
 void* flite_thread(void* phrase) {
   currently_speaking = 1;
-  flite_text_to_speech((char*) phrase, flite_voice, "play");
+  speech_play((char*) phrase);
   currently_speaking = 0;
   return NULL;
 }
@@ -34,7 +39,7 @@ void* flite_thread(void* phrase) {
 // Speak the given phrase in a background thread so that we
 // can interrupt it when it is speaking and the user switches selections
 // or pages.
-char current_phrase[500];
+char current_phrase[speech_phrase_length];
 void flite_speak(char* phrase) {
 
   if(currently_speaking)
@@ -98,6 +103,153 @@ char* trim(char *str)
   return str;
 }
 
+// Append the selection at the given row and column, with the headings
+// that give it context, to the guidance. Selections with a description
+// on the instrument page have it appended to the selection.
+static void build_guidance(char *guidance, int row, int column, char *selection) {
+
+  // Headings are normally found above and to the left of the selection
+  int column_heading_column = column;
+  int row_heading_column = 0;
+
+  // Ajust the heading column in the FX region of the
+  // phrase page, since the alignment is non-standard
+  int is_value = 0;
+  if(strstr(screenbuffer[2], "PHRASE"))
+  {
+    if((column == 15) ||
+       (column == 21) ||
+       (column == 27))
+    {
+        column_heading_column -= 3;
+        is_value = 1;
+    }
+  }
+
+  // Adjust the row headings for the multi-column
+  // instrument page
+  int is_instrument = 0;
+  if(strstr(screenbuffer[2], "INST"))
+  {
+    is_instrument = 1;
+    if(column == 22) { row_heading_column = column_heading_column - 4; }
+    if(column == 27) { row_heading_column = column_heading_column - 10; }
+
+    // See if this is an instrument value with a description
+    if(isalpha(screenbuffer[row][column + 2]))
+    {
+        char instrument_description[40];
+        sscanf(screenbuffer[row] + column + 2, "%s", instrument_description);
+        strcat(selection, " ");
+        strcat(selection, instrument_description);
+    }
+  }
+
+  // Determine current row and column
+  char row_heading[40], column_heading[40];
+  sscanf(screenbuffer[row] + row_heading_column, "%s", row_heading);
+  sscanf(screenbuffer[4] + column_heading_column, "%s", column_heading);
+
+  // Include current selection
+  strcat(guidance, selection);
+
+  // Include context
+  if(is_instrument)
+  {
+    if((strcmp(selection, "LOAD") == 0) ||
+      (strcmp(selection, "SAVE") == 0))
+    {
+      strcpy(row_heading, "INSTRUMENT");
+    }
+
+    strcat(guidance, " ");
+    strcat(guidance, row_heading);
+  }
+  else
+  {
+    strcat(guidance, " . at row ");
+    strcat(guidance, row_heading);
+    strcat(guidance, " column ");
+    strcat(guidance, column_heading);
+  }
+
+  // If this is the value for a column with a name,
+  // add that to the spoken phrase.
+  if(is_value)
+  {
+    strcat(guidance, " value");
+  }
+}
+
+// Find the start of the word before or after the given column of a row,
+// or -1 if there is none
+static int find_word(int row, int column, int direction) {
+  const char *line = screenbuffer[row];
+  int length = strnlen(line, 40);
+
+  if(direction > 0)
+  {
+    // Skip the rest of this word, then the spaces after it
+    int col = column;
+    while(col < length && !isspace((unsigned char)line[col])) col++;
+    while(col < length && isspace((unsigned char)line[col])) col++;
+    return (col < length) ? col : -1;
+  }
+
+  // Skip the spaces before this word, then go to the start of that word
+  int col = column - 1;
+  while(col >= 0 && isspace((unsigned char)line[col])) col--;
+  if(col < 0) { return -1; }
+  while(col > 0 && !isspace((unsigned char)line[col - 1])) col--;
+  return col;
+}
+
+// Predict the selections that cursor movement could lead to next, and have
+// their announcements synthesized while the user is reading this one. These
+// are the words to the left and right of the selection, and the words above
+// and below it in the same column. A page change can't be predicted, as the
+// next page isn't on screen.
+static void predict_neighbors(int row, int column) {
+  char phrases[speech_max_predictions][speech_phrase_length];
+  int count = 0;
+
+  int neighbors[4][2] = {
+    { row, find_word(row, column, 1) },
+    { row, find_word(row, column, -1) },
+    { row + 1, column },
+    { row - 1, column },
+  };
+
+  for(int i = 0; i < 4; i++)
+  {
+    int neighbor_row = neighbors[i][0];
+    int neighbor_column = neighbors[i][1];
+
+    // The rows up to 4 hold the page title and column headings
+    if((neighbor_row <= 4) || (neighbor_row >= 24) || (neighbor_column < 0))
+    {
+      continue;
+    }
+
+    const char *line = screenbuffer[neighbor_row];
+    if((neighbor_column >= (int) strnlen(line, 40)) ||
+       isspace((unsigned char)line[neighbor_column]))
+    {
+      continue;
+    }
+
+    char selection[80] = "";
+    sscanf(line + neighbor_column, "%39s", selection);
+
+    char guidance[speech_phrase_length] = "";
+    build_guidance(guidance, neighbor_row, neighbor_column, selection);
+    pronounce_text(guidance, phrases[count], sizeof(phrases[count]));
+    count++;
+  }
+
+  speech_predict(phrases, count);
+}
+
 void speak_flow() {
 
   // If we haven't initialized flite, initialize it now
@@ -113,8 +265,24 @@ void speak_flow() {
     printf("Loading voice.\r\n");
     flite_voice = flite_voice_select("file://cmu_us_fem.flitevox");
     printf("Loaded.\r\n");
+
+    // Keep the voice's model vectors dequantized once they have been used,
+    // 16MB holds about 36000 of them
+    if(flite_voice != NULL)
+    {
+      flite_feat_set_int(flite_voice->features, "cg_expand_budget", 16 * 1024 * 1024);
+    }
+
+    char dictionary_path[1024];
+    snprintf(dictionary_path, sizeof(dictionary_path), "%spronunciation.txt",
+             SDL_GetPrefPath("", "m8c"));
+    pronounce_load(dictionary_path);
+
+    speech_init(flite_voice);
   }
 
+  render_copy_flow_screen(screenbuffer, selection_buffer, &new_selection_row);
+
   // Get the current page title
   char* new_page = (char *)calloc(40, sizeof(char));
 
@@ -171,151 +339,19 @@ void speak_flow() {
   }
   free(new_page);
 
-  // Determine the current row and column
-  int column_heading_column = new_selection_column;
-  int row_heading_column = 0;
+  build_guidance(guidance, new_selection_row, new_selection_column,
+                 current_selection);
 
-  // Ajust the heading column in the FX region of the
-  // phrase page, since the alignment is non-standard
-  int is_value = 0;
-  if(strstr(screenbuffer[2], "PHRASE"))
-  {
-    if((new_selection_column == 15) ||
-       (new_selection_column == 21) ||
-       (new_selection_column == 27))
-    {
-        column_heading_column -= 3;
-        is_value = 1;
-    }
-  }
-
-  // Adjust the row headings for the multi-column
-  // instrument page
-  int is_instrument = 0;
-  if(strstr(screenbuffer[2], "INST"))
-  {
-    is_instrument = 1;
-    if(new_selection_column == 22) { row_heading_column = column_heading_column - 4; }
-    if(new_selection_column == 27) { row_heading_column = column_heading_column - 10; }
-
-    // See if this is an instrument value with a description
-    if(isalpha(screenbuffer[new_selection_row][new_selection_column + 2]))
-    {
-        char instrument_description[40];
-        sscanf(screenbuffer[new_selection_row] + new_selection_column + 2, "%s", instrument_description);
-        strcat(current_selection, " ");
-        strcat(current_selection, instrument_description);
-    }
-  }
-
-  // Determine current row and column
-  char row_heading[40], column_heading[40];
-  sscanf(screenbuffer[new_selection_row] + row_heading_column, "%s", row_heading);
-  sscanf(screenbuffer[4] + column_heading_column, "%s", column_heading);
-
-  // Include current selection
-  strcat(guidance, current_selection);
-
-  // Include context
-  if(is_instrument)
-  {
-    if((strcmp(current_selection, "LOAD") == 0) ||
-      (strcmp(current_selection, "SAVE") == 0))
-    {
-      strcpy(row_heading, "INSTRUMENT");
-    }
-
-    strcat(guidance, " ");
-    strcat(guidance, row_heading);
-  }
-  else
-  {
-    strcat(guidance, " . at row ");
-    strcat(guidance, row_heading);
-    strcat(guidance, " column ");
-    strcat(guidance, column_heading);
-  }
-
-  // If this is the value for a column with a name,
-  // add that to the spoken phrase.
-  if(is_value)
-  {
-    strcat(guidance, " value");
-  }
-  
   printf("Current guidance: %s\n", guidance);
 
   // Fix abbreviations and annoyances
-  char final_guidance[1000] = "";
-  char current_word[40];
-  char* search_start = guidance;
-  while(sscanf(search_start, "%s", current_word) > 0)
-  {
-    int use_original = 1;
-    char* found = strstr(search_start, current_word);
-
-    if(found)
-    {
-        search_start = found +  + strlen(current_word) + 1;
-
-        char* replacements[] = {
-            "INST.", "Instrument",
-            "MACROSYN", "Macro synth",
-            "-", "NO VALUE",
-            "--", "NO VALUE",
-            "---", "NO VALUE",
-            "PH", "Phrase",
-            "TSP", "Transpose",
-            "N", "Note",
-            "V", "Velocity",
-            "I", "Instrument",
-            "TRANSP.", "Transpose",
-            "RES", "Resonance",
-            "AMP", "Amplification",
-            "LIM", "Limit",
-            "CHO", "Chorus",
-            "DEL", "Delay",
-            "REV", "Reverb",
-            "OUTPUT VOL", "Output Volume",
-            "SPEAKER VOL", "Speaker Volume",
-            "WAV", "Wave",
-        };
-
-        // Fix abbreviations
-        for(int counter = 0; counter < (sizeof(replacements) / sizeof(replacements[0])); counter += 2)
-        {
-            if(strcmp(current_word, replacements[counter]) == 0)
-            {
-                strcat(final_guidance, replacements[counter + 1]);
-                use_original = 0;
-            }           
-        }
-        
-        // Fix speaking hex (like "FE" sounding like "FEE")
-        char* endPtr;
-        if((strlen(current_word) == 2) &&
-            (isalpha(current_word[0]) || isalpha(current_word[1])))
-        {
-            strtol(current_word, &endPtr, 16);
-            if((endPtr - current_word) == 2)
-            {
-                char letters[4] = { current_word[0], ' ', current_word[1], 0 };
-                strcat(final_guidance, letters);
-                use_original = 0;
-            }
-        }
-
-        if(use_original)
-        {
-            strcat(final_guidance, current_word);
-        }
-
-        strcat(final_guidance, " ");
-    }
-  }
+  char final_guidance[speech_phrase_length];
+  pronounce_text(guidance, final_guidance, sizeof(final_guidance));
 
   printf("Final Guidance: %s\n", final_guidance);
  
   free(guidance);
   flite_speak(final_guidance); 
+
+  predict_neighbors(new_selection_row, new_selection_column);
 }
\ No newline at end of file
@@ -0,0 +1,98 @@
+// Adaptive sleeping for the main loops. While something is happening the
+// loop runs at the configured rate. When nothing has happened for a while the
+// sleeps double up to a limit, and they wait on the SDL event queue so any
+// input wakes the loop up immediately.
+
+#include "idle.h"
+
+#include <SDL.h>
+#include <time.h>
+
+#define idle_after_ms 2000 // no activity for this long counts as idle
+
+static int enabled = 0;
+static uint32_t ticks_activity;
+static uint32_t sleep_ms = 0;
+static int idle = 0;
+
+// The current idle period and all idle periods together
+static uint32_t period_ticks;
+static clock_t period_clock;
+static uint32_t period_wakeups;
+static uint32_t total_ms = 0;
+static double total_cpu_ms = 0;
+static uint32_t total_wakeups = 0;
+
+void idle_enable() {
+  enabled = 1;
+  ticks_activity = SDL_GetTicks();
+}
+
+int idle_enabled() { return enabled; }
+
+int idle_is_idle() { return idle; }
+
+void idle_activity() {
+  ticks_activity = SDL_GetTicks();
+  sleep_ms = 0;
+
+  if (!idle)
+    return;
+
+  idle = 0;
+
+  uint32_t elapsed = SDL_GetTicks() - period_ticks;
+  double cpu_ms = (clock() - period_clock) * 1000.0 / CLOCKS_PER_SEC;
+  total_ms += elapsed;
+  total_cpu_ms += cpu_ms;
+  total_wakeups += period_wakeups;
+
+  if (elapsed >= 10000)
+    SDL_Log("Idle for %.1f s: %.1f wakeups/s, %.2f%% CPU", elapsed / 1000.0,
+            period_wakeups * 1000.0 / elapsed, cpu_ms * 100 / elapsed);
+}
+
+uint32_t idle_wait(uint32_t active_ms, uint32_t max_ms) {
+  if (!enabled) {
+    SDL_Delay(active_ms);
+    return active_ms;
+  }
+
+  if (SDL_GetTicks() - ticks_activity < idle_after_ms) {
+    sleep_ms = active_ms;
+  } else {
+    if (!idle) {
+      idle = 1;
+      period_ticks = SDL_GetTicks();
+      period_clock = clock();
+      period_wakeups = 0;
+    }
+    sleep_ms = sleep_ms * 2 > active_ms ? sleep_ms * 2 : active_ms;
+    if (sleep_ms > max_ms)
+      sleep_ms = max_ms;
+    period_wakeups++;
+  }
+
+  uint32_t ticks = SDL_GetTicks();
+
+  // Returns early when an event arrives, it stays queued for the input code
+  if (SDL_WaitEventTimeout(NULL, sleep_ms) == 1 && idle)
+    idle_activity();
+
+  return SDL_GetTicks() - ticks;
+}
+
+void idle_report() {
+  if (!enabled)
+    return;
+
+  // Close the idle period still going on
+  if (idle) {
+    idle_activity();
+  }
+
+  if (total_ms > 0)
+    SDL_Log("Idle for %.1f s in total: %.1f wakeups/s, %.2f%% CPU",
+            total_ms / 1000.0, total_wakeups * 1000.0 / total_ms,
+            total_cpu_ms * 100 / total_ms);
+}
@@ -0,0 +1,18 @@
+#ifndef IDLE_H_
+#define IDLE_H_
+
+#include <stdint.h>
+
+void idle_enable();
+int idle_enabled();
+
+// Input, serial traffic or a device arriving keeps the loop at full rate
+void idle_activity();
+int idle_is_idle();
+
+// Sleeps for active_ms, or longer up to max_ms when there has been no
+// activity for a while. Returns the time slept in ms.
+uint32_t idle_wait(uint32_t active_ms, uint32_t max_ms);
+void idle_report();
+
+#endif
@@ -0,0 +1,3 @@
+#include <stdint.h>
+#define key_up 1
+#define key_down 2
@@ -13,24 +13,31 @@
 
 SDL_GameController *game_controllers[MAX_CONTROLLERS];
 
-// Bits for M8 input messages
-enum keycodes {
-  key_left = 1 << 7,
-  key_up = 1 << 6,
-  key_down = 1 << 5,
-  key_select = 1 << 4,
-  key_start = 1 << 3,
-  key_right = 1 << 2,
-  key_opt = 1 << 1,
-  key_edit = 1
-};
-
 uint8_t keyjazz_enabled = 0;
 uint8_t keyjazz_base_octave = 2;
 uint8_t keyjazz_velocity = 0x64;
 
 static uint8_t keycode = 0; // value of the pressed key
-static int num_joysticks = 0;
+static int num_controllers = 0;
+
+// M8 keycodes in the order of input_buttons_t
+static const uint8_t keycodes[INPUT_MAX] = {
+    key_up, key_down, key_left, key_right,
+    key_opt, key_edit, key_select, key_start};
+
+// Game controller state, updated from SDL controller events
+static SDL_JoystickID controller_ids[MAX_CONTROLLERS];
+static uint32_t controller_buttons[MAX_CONTROLLERS]; // bit per SDL button
+static int16_t controller_axes[MAX_CONTROLLERS][SDL_CONTROLLER_AXIS_MAX];
+
+// SDL button and axis to M8 keycode lookup tables
+static uint8_t button_keycodes[SDL_CONTROLLER_BUTTON_MAX];
+static uint8_t axis_keycodes_negative[SDL_CONTROLLER_AXIS_MAX];
+static uint8_t axis_keycodes_positive[SDL_CONTROLLER_AXIS_MAX];
+static int mappings_built = 0;
+
+static uint8_t gamepad_keycode = 0; // M8 keys held on the game controllers
+static input_msg_s gamepad_special = {normal, 0}; // quit/reset combination
 
 input_msg_s key = {normal, 0};
 
@@ -42,9 +49,17 @@ uint8_t toggle_input_keyjazz() {
 // Opens available game controllers and returns the amount of opened controllers
 int initialize_game_controllers() {
 
-  num_joysticks = SDL_NumJoysticks();
+  int num_joysticks = SDL_NumJoysticks();
   int controller_index = 0;
 
+  // Forget the previous controllers and their state
+  close_game_controllers();
+  num_controllers = 0;
+  SDL_memset(controller_buttons, 0, sizeof(controller_buttons));
+  SDL_memset(controller_axes, 0, sizeof(controller_axes));
+  gamepad_keycode = 0;
+  gamepad_special = (input_msg_s){normal, 0};
+
   SDL_Log("Looking for game controllers\n");
   SDL_Delay(
       10); // Some controllers like XBone wired need a little while to get ready
@@ -81,11 +96,15 @@ int initialize_game_controllers() {
     if (controller_index >= MAX_CONTROLLERS)
       break;
     game_controllers[controller_index] = SDL_GameControllerOpen(i);
+    controller_ids[controller_index] = SDL_JoystickInstanceID(
+        SDL_GameControllerGetJoystick(game_controllers[controller_index]));
     SDL_Log("Controller %d: %s", controller_index + 1,
             SDL_GameControllerName(game_controllers[controller_index]));
     controller_index++;
   }
 
+  num_controllers = controller_index;
+
   return controller_index;
 }
 
@@ -95,6 +114,7 @@ void close_game_controllers() {
   for (int i = 0; i < MAX_CONTROLLERS; i++) {
     if (game_controllers[i])
       SDL_GameControllerClose(game_controllers[i]);
+    game_controllers[i] = NULL;
   }
 }
 
@@ -270,83 +290,125 @@ static input_msg_s handle_normal_keys(SDL_Event *event, config_params_s *conf,
   return key;
 }
 
-// Check whether a button is pressed on a gamepad and return 1 if pressed.
-static int get_game_controller_button(config_params_s *conf,
-                                      SDL_GameController *controller,
-                                      int button) {
+// Builds the SDL button/axis to M8 keycode tables from the config so that
+// controller events can be translated with a single lookup
+static void build_controller_mappings(config_params_s *conf) {
+
+  const int button_mappings[INPUT_MAX] = {
+      conf->gamepad_up,   conf->gamepad_down, conf->gamepad_left,
+      conf->gamepad_right, conf->gamepad_opt, conf->gamepad_edit,
+      conf->gamepad_select, conf->gamepad_start};
+
+  const int axis_mappings[INPUT_MAX] = {
+      conf->gamepad_analog_axis_updown,    conf->gamepad_analog_axis_updown,
+      conf->gamepad_analog_axis_leftright, conf->gamepad_analog_axis_leftright,
+      conf->gamepad_analog_axis_opt,       conf->gamepad_analog_axis_edit,
+      conf->gamepad_analog_axis_select,    conf->gamepad_analog_axis_start};
+
+  // Up and left are triggered by the negative end of their axis, everything
+  // else by the positive end
+  const int axis_negative[INPUT_MAX] = {1, 0, 1, 0, 0, 0, 0, 0};
+
+  SDL_memset(button_keycodes, 0, sizeof(button_keycodes));
+  SDL_memset(axis_keycodes_negative, 0, sizeof(axis_keycodes_negative));
+  SDL_memset(axis_keycodes_positive, 0, sizeof(axis_keycodes_positive));
+
+  for (int button = 0; button < INPUT_MAX; button++) {
+    int sdl_button = button_mappings[button];
+    if (sdl_button >= 0 && sdl_button < SDL_CONTROLLER_BUTTON_MAX)
+      button_keycodes[sdl_button] |= keycodes[button];
+
+    int sdl_axis = axis_mappings[button];
+    if (sdl_axis >= 0 && sdl_axis < SDL_CONTROLLER_AXIS_MAX) {
+      if (axis_negative[button])
+        axis_keycodes_negative[sdl_axis] |= keycodes[button];
+      else
+        axis_keycodes_positive[sdl_axis] |= keycodes[button];
+    }
+  }
 
-  const int button_mappings[8] = {conf->gamepad_up,     conf->gamepad_down,
-                                  conf->gamepad_left,   conf->gamepad_right,
-                                  conf->gamepad_opt,    conf->gamepad_edit,
-                                  conf->gamepad_select, conf->gamepad_start};
+  mappings_built = 1;
+}
 
-  // Check digital buttons
-  if (SDL_GameControllerGetButton(controller, button_mappings[button])) {
-    return 1;
-  } else {
-    // If digital button isn't pressed, check the corresponding analog control
-    switch (button) {
-    case INPUT_UP:
-      return SDL_GameControllerGetAxis(controller,
-                                       conf->gamepad_analog_axis_updown) <
-             -conf->gamepad_analog_threshold;
-    case INPUT_DOWN:
-      return SDL_GameControllerGetAxis(controller,
-                                       conf->gamepad_analog_axis_updown) >
-             conf->gamepad_analog_threshold;
-    case INPUT_LEFT:
-      return SDL_GameControllerGetAxis(controller,
-                                       conf->gamepad_analog_axis_leftright) <
-             -conf->gamepad_analog_threshold;
-    case INPUT_RIGHT:
-      return SDL_GameControllerGetAxis(controller,
-                                       conf->gamepad_analog_axis_leftright) >
-             conf->gamepad_analog_threshold;
-    case INPUT_OPT:
-      return SDL_GameControllerGetAxis(controller,
-                                       conf->gamepad_analog_axis_opt) >
-             conf->gamepad_analog_threshold;
-    case INPUT_EDIT:
-      return SDL_GameControllerGetAxis(controller,
-                                       conf->gamepad_analog_axis_edit) >
-             conf->gamepad_analog_threshold;
-    case INPUT_SELECT:
-      return SDL_GameControllerGetAxis(controller,
-                                       conf->gamepad_analog_axis_select) >
-             conf->gamepad_analog_threshold;
-    case INPUT_START:
-      return SDL_GameControllerGetAxis(controller,
-                                       conf->gamepad_analog_axis_start) >
-             conf->gamepad_analog_threshold;
-    default:
-      return 0;
+static int controller_button_pressed(int gc, int button) {
+  return button >= 0 && button < SDL_CONTROLLER_BUTTON_MAX &&
+         (controller_buttons[gc] & (1u << button));
+}
+
+// Recalculates the active M8 keys and the quit/reset combinations from the
+// stored controller state. Only called when a controller event arrives.
+static void update_game_controller_state(config_params_s *conf) {
+
+  gamepad_keycode = 0;
+  gamepad_special = (input_msg_s){normal, 0};
+
+  for (int gc = 0; gc < num_controllers; gc++) {
+    uint32_t buttons = controller_buttons[gc];
+    for (int button = 0; buttons != 0; button++, buttons >>= 1) {
+      if (buttons & 1)
+        gamepad_keycode |= button_keycodes[button];
+    }
+
+    for (int axis = 0; axis < SDL_CONTROLLER_AXIS_MAX; axis++) {
+      if (controller_axes[gc][axis] < -conf->gamepad_analog_threshold)
+        gamepad_keycode |= axis_keycodes_negative[axis];
+      else if (controller_axes[gc][axis] > conf->gamepad_analog_threshold)
+        gamepad_keycode |= axis_keycodes_positive[axis];
     }
+
+    // Special case game controller buttons quit and reset
+    int axis_select = conf->gamepad_analog_axis_select;
+    int select_held =
+        controller_button_pressed(gc, conf->gamepad_select) ||
+        (axis_select >= 0 && axis_select < SDL_CONTROLLER_AXIS_MAX &&
+         controller_axes[gc][axis_select] != 0);
+
+    if (select_held && controller_button_pressed(gc, conf->gamepad_quit))
+      gamepad_special = (input_msg_s){special, msg_quit};
+    else if (select_held && controller_button_pressed(gc, conf->gamepad_reset))
+      gamepad_special = (input_msg_s){special, msg_reset_display};
   }
-  return 0;
 }
 
-// Handle game controllers, simply check all buttons and analog axis on every
-// cycle
-static int handle_game_controller_buttons(config_params_s *conf) {
+static int find_game_controller(SDL_JoystickID id) {
+  for (int gc = 0; gc < num_controllers; gc++) {
+    if (controller_ids[gc] == id)
+      return gc;
+  }
+  return -1;
+}
 
-  const int keycodes[8] = {key_up,  key_down, key_left,   key_right,
-                           key_opt, key_edit, key_select, key_start};
+// Updates the controller state from a button or axis event. Returns 1 if the
+// event was a controller input event and has been consumed.
+static int handle_game_controller_event(config_params_s *conf,
+                                        SDL_Event *event) {
+  int gc;
+
+  switch (event->type) {
+  case SDL_CONTROLLERBUTTONDOWN:
+  case SDL_CONTROLLERBUTTONUP:
+    gc = find_game_controller(event->cbutton.which);
+    if (gc < 0 || event->cbutton.button >= SDL_CONTROLLER_BUTTON_MAX)
+      return 1;
+    if (event->type == SDL_CONTROLLERBUTTONDOWN)
+      controller_buttons[gc] |= 1u << event->cbutton.button;
+    else
+      controller_buttons[gc] &= ~(1u << event->cbutton.button);
+    break;
 
-  int key = 0;
+  case SDL_CONTROLLERAXISMOTION:
+    gc = find_game_controller(event->caxis.which);
+    if (gc < 0 || event->caxis.axis >= SDL_CONTROLLER_AXIS_MAX)
+      return 1;
+    controller_axes[gc][event->caxis.axis] = event->caxis.value;
+    break;
 
-  // Cycle through every active game controller
-  for (int gc = 0; gc < num_joysticks; gc++) {
-    // Cycle through all M8 buttons
-    for (int button = 0; button < (input_buttons_t)INPUT_MAX; button++) {
-      // If the button is active, add the keycode to the variable containing
-      // active keys
-      if (get_game_controller_button(conf, game_controllers[gc], button)) {
-        key |= keycodes[button];
-      }
-    }
+  default:
+    return 0;
   }
 
-  return key;
+  update_game_controller_state(conf);
+  return 1;
 }
 
 // Handles SDL input events
@@ -355,27 +417,28 @@ void handle_sdl_events(config_params_s *conf) {
   static int prev_key_analog = 0;
 
   SDL_Event event;
+  event.type = 0;
 
-  // Read joysticks
-  int key_analog = handle_game_controller_buttons(conf);
-  if (prev_key_analog != key_analog) {
-    keycode = key_analog;
-    prev_key_analog = key_analog;
+  if (!mappings_built)
+    build_controller_mappings(conf);
+
+  // Controller button and axis events only update the controller state, so
+  // consume them all and stop at the first other event to handle it below
+  while (SDL_PollEvent(&event)) {
+    if (!handle_game_controller_event(conf, &event))
+      break;
+    event.type = 0;
   }
 
-  // Read special case game controller buttons quit and reset
-  for (int gc = 0; gc < num_joysticks; gc++) {
-    if (SDL_GameControllerGetButton(game_controllers[gc], conf->gamepad_quit) && 
-        (SDL_GameControllerGetButton(game_controllers[gc], conf->gamepad_select) || 
-        SDL_GameControllerGetAxis(game_controllers[gc], conf->gamepad_analog_axis_select)))
-      key = (input_msg_s){special, msg_quit};
-    else if (SDL_GameControllerGetButton(game_controllers[gc], conf->gamepad_reset) && 
-            (SDL_GameControllerGetButton(game_controllers[gc], conf->gamepad_select) || 
-              SDL_GameControllerGetAxis(game_controllers[gc], conf->gamepad_analog_axis_select)))
-      key = (input_msg_s){special, msg_reset_display};
+  // Read joysticks
+  if (prev_key_analog != gamepad_keycode) {
+    keycode = gamepad_keycode;
+    prev_key_analog = gamepad_keycode;
   }
 
-  SDL_PollEvent(&event);
+  // Read special case game controller buttons quit and reset
+  if (gamepad_special.type == special)
+    key = gamepad_special;
 
   switch (event.type) {
 
@@ -398,6 +461,15 @@ void handle_sdl_events(config_params_s *conf) {
     }
     break;
 
+  // With several devices a click on one gives it the input
+  case SDL_MOUSEBUTTONDOWN:
+    if (event.button.button == SDL_BUTTON_LEFT) {
+      int device = render_device_at(event.button.x, event.button.y);
+      if (device >= 0)
+        key = (input_msg_s){special, msg_focus_device, device};
+    }
+    break;
+
   // Keyboard events. Special events are handled within SDL_KEYDOWN.
   case SDL_KEYDOWN:
 
@@ -415,6 +487,13 @@ void handle_sdl_events(config_params_s *conf) {
       break;
     }
 
+    // CTRL+TAB moves the input to the next device
+    if (event.key.keysym.sym == SDLK_TAB &&
+        (event.key.keysym.mod & KMOD_CTRL) > 0) {
+      key = (input_msg_s){special, msg_next_device};
+      break;
+    }
+
     // ESC = toggle keyjazz
     if (event.key.keysym.sym == SDLK_ESCAPE) {
       display_keyjazz_overlay(toggle_input_keyjazz(), keyjazz_base_octave, keyjazz_velocity);
@@ -443,6 +522,10 @@ void handle_sdl_events(config_params_s *conf) {
   case keyjazz:
     // Do not allow pressing multiple keys with keyjazz
   case special:
+    // Device switching happens once per press, it is not held like the keys
+    if (key.type == special &&
+        (key.value == msg_focus_device || key.value == msg_next_device))
+      break;
     if (event.type == SDL_KEYDOWN) {
       keycode = key.value;
     } else {
@@ -18,6 +18,18 @@ typedef enum input_buttons_t {
     INPUT_MAX
 } input_buttons_t;
 
+// Bits for M8 input messages
+enum keycodes {
+  key_left = 1 << 7,
+  key_up = 1 << 6,
+  key_down = 1 << 5,
+  key_select = 1 << 4,
+  key_start = 1 << 3,
+  key_right = 1 << 2,
+  key_opt = 1 << 1,
+  key_edit = 1
+};
+
 typedef enum input_type_t {
   normal,
   keyjazz,
@@ -26,7 +38,9 @@ typedef enum input_type_t {
 
 typedef enum special_messages_t {
   msg_quit = 1,
-  msg_reset_display = 2
+  msg_reset_display = 2,
+  msg_focus_device = 3, // value2 is the device index
+  msg_next_device = 4
 } special_messages_t;
 
 typedef struct input_msg_s {
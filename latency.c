@@ -0,0 +1,211 @@
+// Input-to-photon latency measurement. A cursor key press is sent to the M8
+// and timestamped, then the time until the first drawing command changing
+// the cursor region arrives and until that frame is presented is recorded.
+// Up and down presses alternate so the cursor stays in the same area.
+
+#include "latency.h"
+
+#include <SDL.h>
+
+#include "input.h"
+
+#define latency_settle_ms 300  // quiet time before the next key press
+#define latency_timeout_ms 1000 // give up waiting for a response after this
+#define latency_columns 40
+#define latency_rows 24
+
+enum latency_state {
+  latency_idle,
+  latency_wait_response,
+  latency_wait_present,
+  latency_release
+};
+
+static enum latency_state state = latency_idle;
+static int enabled = 0;
+static int samples_wanted;
+static int samples_taken = 0;
+static int timeouts = 0;
+static uint8_t next_key = key_down;
+
+static uint64_t press_counter;  // performance counter value at key press
+static uint64_t packet_counter; // first matching draw command
+static uint32_t ticks_state;
+
+// Last known cursor cell, from the most recent highlighted character
+static int cursor_column = -1, cursor_row = -1;
+
+// What was last drawn in each cell, so that the M8 redrawing the same
+// highlight or a rectangle of the same colour isn't taken as the response
+static uint64_t cells[latency_rows][latency_columns];
+
+static uint32_t *packet_latency; // microseconds
+static uint32_t *present_latency;
+
+void latency_enable(int samples) {
+  enabled = 1;
+  samples_wanted = samples;
+  packet_latency = calloc(samples, sizeof(uint32_t));
+  present_latency = calloc(samples, sizeof(uint32_t));
+  ticks_state = SDL_GetTicks();
+  SDL_Log("Measuring input latency over %d key presses", samples);
+}
+
+int latency_enabled() { return enabled; }
+
+// Finished once every key press has been answered or has timed out, and the
+// last key has been released
+int latency_done() {
+  return enabled && samples_taken + timeouts >= samples_wanted &&
+         state == latency_idle;
+}
+
+static uint32_t counter_to_us(uint64_t counter) {
+  return (uint32_t)(counter * 1000000 / SDL_GetPerformanceFrequency());
+}
+
+// Called once per main loop iteration. Returns 1 and sets input to the key
+// state to send to the M8 when a key should be pressed or released.
+int latency_poll(uint8_t *input) {
+  uint32_t ticks = SDL_GetTicks();
+
+  if (!enabled)
+    return 0;
+
+  switch (state) {
+  case latency_idle:
+    if (samples_taken + timeouts >= samples_wanted ||
+        ticks - ticks_state < latency_settle_ms)
+      return 0;
+    *input = next_key;
+    next_key = next_key == key_down ? key_up : key_down;
+    press_counter = SDL_GetPerformanceCounter();
+    ticks_state = ticks;
+    state = latency_wait_response;
+    return 1;
+
+  case latency_wait_response:
+  case latency_wait_present:
+    if (ticks - ticks_state < latency_timeout_ms)
+      return 0;
+    timeouts++;
+    state = latency_release;
+    return 0;
+
+  case latency_release:
+    *input = 0;
+    ticks_state = ticks;
+    state = latency_idle;
+    return 1;
+  }
+
+  return 0;
+}
+
+static void response() {
+  if (state == latency_wait_response) {
+    packet_counter = SDL_GetPerformanceCounter();
+    state = latency_wait_present;
+  }
+}
+
+void latency_draw_character(int column, int row, uint8_t c, uint32_t fgcolor,
+                            uint32_t bgcolor) {
+  if (!enabled || column < 0 || column >= latency_columns || row < 0 ||
+      row >= latency_rows)
+    return;
+
+  uint64_t content = (uint64_t)bgcolor << 32 | (uint64_t)fgcolor << 8 | c;
+  int highlighted = bgcolor != 0;
+  int changed = cells[row][column] != content;
+  cells[row][column] = content;
+
+  // The old cursor cell drawn differently, or a cell newly highlighted,
+  // means the cursor moved
+  if (changed && (highlighted ||
+                  (column == cursor_column && row == cursor_row)))
+    response();
+
+  if (highlighted) {
+    cursor_column = column;
+    cursor_row = row;
+  }
+}
+
+void latency_draw_rectangle(int x, int y, int w, int h, uint32_t color) {
+  if (!enabled)
+    return;
+
+  // Cells are 8x10 pixels from (8, 10), as placed by draw_character
+  uint64_t content = 1ULL << 63 | color;
+  int first_column = x < 8 ? 0 : (x - 8) / 8;
+  int first_row = y < 10 ? 0 : (y - 10) / 10;
+  for (int row = first_row; row < latency_rows && 10 + row * 10 < y + h;
+       row++) {
+    for (int column = first_column;
+         column < latency_columns && 8 + column * 8 < x + w; column++) {
+      if (cells[row][column] == content)
+        continue;
+      cells[row][column] = content;
+      if (column == cursor_column && row == cursor_row)
+        response();
+    }
+  }
+}
+
+void latency_presented() {
+  if (!enabled || state != latency_wait_present)
+    return;
+
+  uint64_t counter = SDL_GetPerformanceCounter();
+  packet_latency[samples_taken] = counter_to_us(packet_counter - press_counter);
+  present_latency[samples_taken] = counter_to_us(counter - press_counter);
+  samples_taken++;
+  state = latency_release;
+}
+
+static int compare_samples(const void *a, const void *b) {
+  uint32_t x = *(const uint32_t *)a;
+  uint32_t y = *(const uint32_t *)b;
+  return (x > y) - (x < y);
+}
+
+static void report_distribution(const char *name, uint32_t *samples,
+                                int count) {
+  SDL_qsort(samples, count, sizeof(uint32_t), compare_samples);
+  SDL_Log("%s latency in ms: min %.2f p50 %.2f p90 %.2f p99 %.2f max %.2f",
+          name, samples[0] / 1000.0f, samples[count / 2] / 1000.0f,
+          samples[count * 9 / 10] / 1000.0f, samples[count * 99 / 100] / 1000.0f,
+          samples[count - 1] / 1000.0f);
+
+  // Histogram with 2 ms buckets
+  int bucket_count[16] = {0};
+  for (int i = 0; i < count; i++) {
+    int bucket = samples[i] / 2000;
+    bucket_count[bucket < 15 ? bucket : 15]++;
+  }
+  for (int bucket = 0; bucket < 16; bucket++) {
+    if (bucket_count[bucket] == 0)
+      continue;
+    if (bucket < 15)
+      SDL_Log("  %2d-%2d ms: %d", bucket * 2, bucket * 2 + 2,
+              bucket_count[bucket]);
+    else
+      SDL_Log("  >=30 ms: %d", bucket_count[bucket]);
+  }
+}
+
+void latency_report() {
+  if (!enabled)
+    return;
+
+  SDL_Log("Latency: %d samples, %d timeouts", samples_taken, timeouts);
+  if (samples_taken > 0) {
+    report_distribution("Key to draw command", packet_latency, samples_taken);
+    report_distribution("Key to present", present_latency, samples_taken);
+  }
+
+  free(packet_latency);
+  free(present_latency);
+  enabled = 0;
+}
@@ -0,0 +1,18 @@
+#ifndef LATENCY_H_
+#define LATENCY_H_
+
+#include <stdint.h>
+
+void latency_enable(int samples);
+int latency_enabled();
+int latency_poll(uint8_t *input);
+int latency_done();
+void latency_report();
+
+// Hooks called by the renderer, characters are given in cells
+void latency_draw_character(int column, int row, uint8_t c, uint32_t fgcolor,
+                            uint32_t bgcolor);
+void latency_draw_rectangle(int x, int y, int w, int h, uint32_t color);
+void latency_presented();
+
+#endif
@@ -0,0 +1,478 @@
+// M8 headless device simulator for testing m8c without hardware.
+//
+// Opens a pseudo-terminal and speaks the M8 serial protocol on it: it answers
+// the display enable/reset/disconnect, controller and keyjazz messages sent
+// by m8c and emits SLIP encoded draw packets at configurable rates. Start it,
+// then point m8c at the printed port with `--port`.
+//
+// The load is given either on the command line or as a script file with one
+// phase per line:
+//   <seconds> <fps> <characters per frame> <rectangles per frame> <scope width>
+// Lines starting with # are ignored.
+
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 600
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "input.h"
+#include "slip.h"
+
+#define max_phases 64
+#define max_packet_size (1 + 3 + 320)
+
+enum packet_types { packet_rect, packet_char, packet_scope, packet_joypad };
+
+typedef struct phase_s {
+  int seconds; // 0 = forever
+  int fps;
+  int characters;
+  int rectangles;
+  int scope_width;
+} phase_s;
+
+static phase_s phases[max_phases];
+static int num_phases = 0;
+static int loop_script = 0;
+static int redraw_every_frame = 0;
+
+static volatile sig_atomic_t running = 1;
+static int master_fd;
+
+static int display_enabled = 0;
+static int full_redraw = 0;
+static int cursor_col = 1, cursor_row = 4;
+
+static uint32_t random_state = 0x12345678;
+
+// Statistics for the current reporting interval
+static uint32_t packets_sent[4];
+static uint64_t bytes_sent = 0;
+static uint32_t frames_sent = 0;
+static uint32_t frames_skipped = 0;
+static uint64_t write_wait_ns = 0;
+
+static void signal_handler(int dummy) { running = 0; }
+
+// Installs the handler without SA_RESTART, so a write blocked on a full pty
+// fails with EINTR and sees running cleared
+static void install_signal_handler(int signum) {
+  struct sigaction action;
+
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = signal_handler;
+  sigemptyset(&action.sa_mask);
+  sigaction(signum, &action, NULL);
+}
+
+static uint64_t now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// xorshift32, deterministic between runs
+static uint32_t next_random() {
+  random_state ^= random_state << 13;
+  random_state ^= random_state >> 17;
+  random_state ^= random_state << 5;
+  return random_state;
+}
+
+static void write_all(const uint8_t *data, size_t size) {
+  uint64_t start = now_ns();
+  while (size > 0 && running) {
+    ssize_t written = write(master_fd, data, size);
+    if (written < 0) {
+      if (errno == EINTR)
+        continue; // stops if a signal cleared running
+      perror("write");
+      running = 0;
+      return;
+    }
+    data += written;
+    size -= written;
+  }
+  write_wait_ns += now_ns() - start;
+}
+
+static void send_packet(int type, const uint8_t *data, int size) {
+  uint8_t encoded[max_packet_size * 2 + 1];
+  int length = 0;
+
+  for (int i = 0; i < size; i++) {
+    if (data[i] == SLIP_SPECIAL_BYTE_END) {
+      encoded[length++] = SLIP_SPECIAL_BYTE_ESC;
+      encoded[length++] = SLIP_ESCAPED_BYTE_END;
+    } else if (data[i] == SLIP_SPECIAL_BYTE_ESC) {
+      encoded[length++] = SLIP_SPECIAL_BYTE_ESC;
+      encoded[length++] = SLIP_ESCAPED_BYTE_ESC;
+    } else {
+      encoded[length++] = data[i];
+    }
+  }
+  encoded[length++] = SLIP_SPECIAL_BYTE_END;
+
+  write_all(encoded, length);
+  packets_sent[type]++;
+  bytes_sent += length;
+}
+
+static void encode_int16(uint8_t *data, uint16_t value) {
+  data[0] = value & 0xFF;
+  data[1] = value >> 8;
+}
+
+static void send_rectangle(int x, int y, int w, int h, uint8_t r, uint8_t g,
+                           uint8_t b) {
+  uint8_t packet[12] = {0xFE};
+  encode_int16(&packet[1], x);
+  encode_int16(&packet[3], y);
+  encode_int16(&packet[5], w);
+  encode_int16(&packet[7], h);
+  packet[9] = r;
+  packet[10] = g;
+  packet[11] = b;
+  send_packet(packet_rect, packet, sizeof(packet));
+}
+
+// Characters are placed on the same 8x10 grid m8c uses for its screen buffer
+static void send_character(int col, int row, char c, int highlighted) {
+  uint8_t packet[12] = {0xFD, (uint8_t)c};
+  encode_int16(&packet[2], 8 + col * 8);
+  encode_int16(&packet[4], 10 + row * 10);
+  packet[6] = packet[7] = packet[8] = highlighted ? 0x00 : 0xC0;
+  packet[9] = packet[10] = packet[11] = highlighted ? 0xC0 : 0x00;
+  send_packet(packet_char, packet, sizeof(packet));
+}
+
+static void send_scope(int width, uint32_t frame) {
+  uint8_t packet[max_packet_size] = {0xFC, 0x00, 0xC0, 0xFF};
+  for (int i = 0; i < width; i++)
+    packet[4 + i] = ((i + frame) * 7 + (next_random() & 3)) % 21;
+  send_packet(packet_scope, packet, 4 + width);
+}
+
+static void send_joypad_state(uint8_t keys) {
+  uint8_t packet[3] = {0xFB, keys, 0x00};
+  send_packet(packet_joypad, packet, sizeof(packet));
+}
+
+static void send_full_screen() {
+  static const char *title = "SONG";
+  send_rectangle(0, 0, 320, 240, 0, 0, 0);
+  for (int i = 0; title[i]; i++)
+    send_character(1 + i, 2, title[i], 0);
+  for (int row = 4; row < 23; row++) {
+    for (int col = 0; col < 39; col++)
+      send_character(col, row, (col % 3 == 2) ? ' ' : '-',
+                     col == cursor_col && row == cursor_row);
+  }
+}
+
+static void move_cursor(uint8_t keys) {
+  int col = cursor_col, row = cursor_row;
+
+  if (keys & key_up)
+    row--;
+  if (keys & key_down)
+    row++;
+  if (keys & key_left)
+    col -= 3;
+  if (keys & key_right)
+    col += 3;
+
+  if (row < 4 || row > 22 || col < 0 || col > 37)
+    return;
+
+  // Redraw the old cell normally and the new cell highlighted
+  send_character(cursor_col, cursor_row, '-', 0);
+  cursor_col = col;
+  cursor_row = row;
+  send_character(cursor_col, cursor_row, '-', 1);
+}
+
+// Parses the messages m8c sends: 'D' enable/disconnect, 'E' 'R' reset
+// display, 'C' + keys controller state and 'K' + note + velocity keyjazz
+static void handle_input(const uint8_t *data, int size) {
+  static uint8_t message[3];
+  static int message_size = 0;
+
+  for (int i = 0; i < size; i++) {
+    message[message_size++] = data[i];
+
+    switch (message[0]) {
+    case 'D':
+      display_enabled = !display_enabled;
+      fprintf(stderr, "Display %s\n",
+              display_enabled ? "enabled" : "disconnected");
+      message_size = 0;
+      break;
+    case 'E':
+      message_size = 0;
+      break;
+    case 'R':
+      display_enabled = 1;
+      full_redraw = 1;
+      message_size = 0;
+      break;
+    case 'C':
+      if (message_size < 2)
+        break;
+      if (display_enabled) {
+        move_cursor(message[1]);
+        send_joypad_state(message[1]);
+      }
+      message_size = 0;
+      break;
+    case 'K':
+      if (message_size < 3)
+        break;
+      message_size = 0;
+      break;
+    default:
+      fprintf(stderr, "Unknown message byte 0x%02X\n", message[0]);
+      message_size = 0;
+      break;
+    }
+  }
+}
+
+static void send_frame(const phase_s *phase, uint32_t frame) {
+  if (full_redraw || redraw_every_frame) {
+    full_redraw = 0;
+    send_full_screen();
+  }
+
+  for (int i = 0; i < phase->rectangles; i++) {
+    uint32_t r = next_random();
+    send_rectangle(r % 300, (r >> 9) % 220, 4 + (r >> 17) % 16,
+                   2 + (r >> 21) % 10, r >> 24, r >> 8, r);
+  }
+
+  for (int i = 0; i < phase->characters; i++) {
+    uint32_t r = next_random();
+    int col = r % 39;
+    int row = 4 + (r >> 8) % 19;
+    if (col == cursor_col && row == cursor_row)
+      continue;
+    send_character(col, row, 'A' + (r >> 16) % 26, 0);
+  }
+
+  if (phase->scope_width > 0)
+    send_scope(phase->scope_width, frame);
+
+  frames_sent++;
+}
+
+static void report_stats(const phase_s *phase, double seconds) {
+  fprintf(stderr,
+          "%5.1f fps (target %d), %u skipped | rect %.0f/s char %.0f/s "
+          "scope %.0f/s | %.1f kB/s | blocked %.1f%%\n",
+          frames_sent / seconds, phase->fps, frames_skipped,
+          packets_sent[packet_rect] / seconds,
+          packets_sent[packet_char] / seconds,
+          packets_sent[packet_scope] / seconds, bytes_sent / seconds / 1024,
+          write_wait_ns / (seconds * 1e7));
+
+  memset(packets_sent, 0, sizeof(packets_sent));
+  bytes_sent = 0;
+  frames_sent = 0;
+  frames_skipped = 0;
+  write_wait_ns = 0;
+}
+
+static int load_script(const char *filename) {
+  FILE *file = fopen(filename, "r");
+  char line[256];
+
+  if (file == NULL) {
+    perror(filename);
+    return -1;
+  }
+
+  while (fgets(line, sizeof(line), file) && num_phases < max_phases) {
+    phase_s *phase = &phases[num_phases];
+    if (line[0] == '#')
+      continue;
+    if (sscanf(line, "%d %d %d %d %d", &phase->seconds, &phase->fps,
+               &phase->characters, &phase->rectangles,
+               &phase->scope_width) == 5 &&
+        phase->fps > 0) {
+      if (phase->scope_width > 320)
+        phase->scope_width = 320;
+      num_phases++;
+    }
+  }
+
+  fclose(file);
+  return num_phases > 0 ? 0 : -1;
+}
+
+// Opens the pty master and puts the slave side in raw mode, so that nothing
+// is echoed back before m8c has opened and configured the port
+static int open_pty(int *slave_fd) {
+  int fd = posix_openpt(O_RDWR | O_NOCTTY);
+  if (fd < 0 || grantpt(fd) != 0 || unlockpt(fd) != 0) {
+    perror("posix_openpt");
+    return -1;
+  }
+
+  // Keeping the slave open prevents a hangup when m8c closes the port
+  *slave_fd = open(ptsname(fd), O_RDWR | O_NOCTTY);
+  if (*slave_fd < 0) {
+    perror(ptsname(fd));
+    return -1;
+  }
+
+  struct termios tio;
+  tcgetattr(*slave_fd, &tio);
+  cfmakeraw(&tio);
+  tcsetattr(*slave_fd, TCSANOW, &tio);
+
+  return fd;
+}
+
+static void print_usage(const char *name) {
+  fprintf(stderr,
+          "Usage: %s [--fps N] [--chars N] [--rects N] [--scope N] "
+          "[--full] [--seconds N] [--script file [--loop]]\n"
+          "  --fps N       frames per second (default 60)\n"
+          "  --chars N     characters drawn per frame (default 20)\n"
+          "  --rects N     rectangles drawn per frame (default 2)\n"
+          "  --scope N     oscilloscope width per frame, 0-320 (default 320)\n"
+          "  --full        redraw the full screen every frame\n"
+          "  --seconds N   stop after N seconds (default: run forever)\n"
+          "  --script file run the load phases in file\n"
+          "  --loop        repeat the script forever\n",
+          name);
+}
+
+int main(int argc, char *argv[]) {
+  phase_s command_line_phase = {0, 60, 20, 2, 320};
+  const char *script = NULL;
+  int slave_fd;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc)
+      command_line_phase.fps = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--chars") == 0 && i + 1 < argc)
+      command_line_phase.characters = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--rects") == 0 && i + 1 < argc)
+      command_line_phase.rectangles = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--scope") == 0 && i + 1 < argc)
+      command_line_phase.scope_width = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--full") == 0)
+      redraw_every_frame = 1;
+    else if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc)
+      command_line_phase.seconds = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--script") == 0 && i + 1 < argc)
+      script = argv[++i];
+    else if (strcmp(argv[i], "--loop") == 0)
+      loop_script = 1;
+    else {
+      print_usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (command_line_phase.fps <= 0 || command_line_phase.scope_width < 0 ||
+      command_line_phase.scope_width > 320) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  if (script != NULL) {
+    if (load_script(script) != 0) {
+      fprintf(stderr, "No valid phases in %s\n", script);
+      return 1;
+    }
+  } else {
+    phases[num_phases++] = command_line_phase;
+  }
+
+  install_signal_handler(SIGINT);
+  install_signal_handler(SIGTERM);
+  signal(SIGPIPE, SIG_IGN);
+
+  master_fd = open_pty(&slave_fd);
+  if (master_fd < 0)
+    return 1;
+
+  printf("%s\n", ptsname(master_fd));
+  fflush(stdout);
+
+  int phase_index = 0;
+  uint64_t phase_start = now_ns();
+  uint64_t next_frame = phase_start;
+  uint64_t last_report = phase_start;
+  uint32_t frame = 0;
+
+  while (running) {
+    const phase_s *phase = &phases[phase_index];
+    uint64_t frame_interval = 1000000000ULL / phase->fps;
+    uint64_t now = now_ns();
+
+    // Move on to the next phase
+    if (phase->seconds > 0 &&
+        now - phase_start >= (uint64_t)phase->seconds * 1000000000ULL) {
+      phase_index++;
+      if (phase_index == num_phases) {
+        if (!loop_script)
+          break;
+        phase_index = 0;
+      }
+      phase_start = now;
+      fprintf(stderr, "Phase %d: %d fps, %d chars, %d rects, scope %d\n",
+              phase_index + 1, phases[phase_index].fps,
+              phases[phase_index].characters, phases[phase_index].rectangles,
+              phases[phase_index].scope_width);
+      continue;
+    }
+
+    // Wait for input from m8c or for the next frame
+    struct pollfd pfd = {master_fd, POLLIN, 0};
+    int timeout_ms = next_frame > now ? (next_frame - now) / 1000000 : 0;
+    if (poll(&pfd, 1, timeout_ms) > 0 && (pfd.revents & POLLIN)) {
+      uint8_t buf[64];
+      ssize_t bytes = read(master_fd, buf, sizeof(buf));
+      if (bytes > 0)
+        handle_input(buf, bytes);
+    }
+
+    now = now_ns();
+    if (now >= next_frame) {
+      if (display_enabled)
+        send_frame(phase, frame++);
+
+      next_frame += frame_interval;
+
+      // Could not keep up with the target rate, skip the missed frames
+      if (now_ns() > next_frame + frame_interval) {
+        uint64_t behind = (now_ns() - next_frame) / frame_interval;
+        frames_skipped += behind;
+        next_frame += behind * frame_interval;
+      }
+    }
+
+    if (now - last_report >= 1000000000ULL) {
+      if (display_enabled)
+        report_stats(phase, (now - last_report) / 1e9);
+      last_report = now;
+    }
+  }
+
+  close(slave_fd);
+  close(master_fd);
+  return 0;
+}
@@ -11,15 +11,25 @@
 
 #include "command.h"
 #include "config.h"
+#include "device.h"
 #include "input.h"
+#include "idle.h"
+#include "latency.h"
+#include "pacing.h"
 #include "render.h"
+#include "replay.h"
 #include "serial.h"
+#include "shm_export.h"
 #include "slip.h"
+#include "stats.h"
 #include "write.h"
 
 // maximum amount of bytes to read from the serial in one read()
 #define serial_read_size 324
 
+// screensaver frame interval when idling in low power mode
+#define screensaver_idle_ms 250
+
 enum state { QUIT, WAIT_FOR_DEVICE, RUN };
 
 enum state run = WAIT_FOR_DEVICE;
@@ -29,12 +39,318 @@ uint8_t need_display_reset = 0;
 void intHandler(int dummy) { run = QUIT; }
 
 void close_serial_port(struct sp_port *port) {
+  if (port == NULL)
+    return;
   disconnect(port);
   sp_close(port);
   sp_free_port(port);
 }
 
+static void print_usage(const char *name) {
+  printf("Usage: %s [--record file] [--replay file [--speed N | --max]]\n"
+         "          [--headless [--frame-hash] [--dump-frames dir]]\n"
+         "          [--stats] [--stats-overlay] [--latency N] [--port name]\n"
+         "          [--all-devices] [--shm name]\n"
+         "  --record file       store the raw serial data from the M8 into file\n"
+         "  --replay file       play back a recording without a device attached\n"
+         "  --speed N           replay at N times the recorded speed\n"
+         "  --max               replay as fast as possible\n"
+         "  --headless          render offscreen without a window\n"
+         "  --frame-hash        print a checksum of every headless frame\n"
+         "  --dump-frames dir   save every headless frame as a BMP file\n"
+         "  --stats             log pipeline timings every 5 seconds\n"
+         "  --stats-overlay     show pipeline timings on the screen\n"
+         "  --latency N         measure input latency over N key presses\n"
+         "  --port name         use this serial port instead of detecting, give\n"
+         "                      several times to run more than one M8\n"
+         "  --all-devices       run all connected M8s in one window\n"
+         "  --shm name          export the screen to POSIX shared memory\n",
+         name);
+}
+
+// Reads the next bytes from the device, or from the recording when replaying
+static int read_serial(struct sp_port *port, uint8_t *buf, int replaying) {
+  int bytes_read;
+
+  stats_begin();
+  if (replaying)
+    bytes_read = replay_read(buf, serial_read_size);
+  else
+    bytes_read = sp_nonblocking_read(port, buf, serial_read_size);
+  stats_end(stats_serial_read);
+
+  if (bytes_read > 0 && !replaying)
+    record_write(buf, bytes_read);
+  return bytes_read;
+}
+
+// Sends the input to the M8. Returns the special message of the input, if
+// it is one that was not handled here.
+static int send_input(input_msg_s input, struct sp_port *port,
+                      uint8_t *prev_input, uint8_t *prev_note) {
+  switch (input.type) {
+  case normal:
+    if (input.value != *prev_input) {
+      *prev_input = input.value;
+      if (port != NULL)
+        send_msg_controller(port, input.value);
+    }
+    break;
+  case keyjazz:
+    if (input.value != 0 && port != NULL) {
+      if (input.eventType == SDL_KEYDOWN && input.value != *prev_input) {
+        send_msg_keyjazz(port, input.value, input.value2);
+        *prev_note = input.value;
+      } else if (input.eventType == SDL_KEYUP && input.value == *prev_note) {
+        send_msg_keyjazz(port, 0xFF, 0);
+      }
+    }
+    *prev_input = input.value;
+    break;
+  case special:
+    if (input.value != *prev_input) {
+      *prev_input = input.value;
+      switch (input.value) {
+      case msg_quit:
+        SDL_Log("Received msg_quit from input device.");
+        run = 0;
+        break;
+      case msg_reset_display:
+        if (port != NULL)
+          reset_display(port);
+        break;
+      default:
+        return input.value;
+      }
+      break;
+    }
+  }
+  return 0;
+}
+
+// Decodes and draws what the reader thread of a device has received
+static void process_device(m8_device_s *device, uint8_t *buf) {
+  render_select_device(device->index);
+
+  int bytes_read;
+  while ((bytes_read = device_read(device, buf, serial_read_size)) > 0) {
+    idle_activity();
+    for (int i = 0; i < bytes_read; i++) {
+      int n = slip_read_byte(&device->slip, buf[i]);
+      if (n == SLIP_ERROR_INVALID_PACKET)
+        reset_display(device->port);
+      else if (n != SLIP_NO_ERROR)
+        SDL_LogError(SDL_LOG_CATEGORY_ERROR, "Device %d: SLIP error %d\n",
+                     device->index, n);
+    }
+  }
+
+  if (bytes_read < 0) {
+    SDL_LogError(SDL_LOG_CATEGORY_ERROR, "Device %d disconnected",
+                 device->index);
+    device_stop(device);
+    close_serial_port(device->port);
+    device->port = NULL;
+  }
+}
+
+// Runs several M8s from one process, shown tiled in a single window. Each
+// device has its own decoder and screen, the font, the speech and the window
+// are shared. Input goes to the focused device, which is changed by clicking
+// its screen or with CTRL+TAB. Recording, replay, headless rendering and the
+// latency measurement work with a single device only.
+static int run_devices(config_params_s *conf, const char **names, int count,
+                       int stats_dump, int stats_overlay) {
+  static m8_device_s devices[max_devices];
+  static uint8_t serial_buf[serial_read_size];
+  uint8_t prev_input = 0;
+  uint8_t prev_note = 0;
+  int focused = 0;
+  int started = 0;
+
+  // Paced presents wait for the vertical blank
+  if (conf->frame_pacing)
+    SDL_SetHint(SDL_HINT_RENDER_VSYNC, "1");
+  if (initialize_sdl(conf->init_fullscreen, conf->init_use_gpu) == -1)
+    return -1;
+
+  if (conf->frame_pacing) {
+    int vsync;
+    int refresh_rate = get_display_refresh(&vsync);
+    pacing_enable(refresh_rate, vsync);
+  }
+
+  if (stats_dump || stats_overlay)
+    stats_enable(stats_overlay, stats_dump ? 5000 : 0);
+
+  // An interrupt during the setup is kept
+  run = render_set_device_count(count) == 1 && run != QUIT ? RUN : QUIT;
+
+  for (int i = 0; i < count && run == RUN; i++) {
+    struct sp_port *port = open_serial_port(names[i]);
+    if (port == NULL || enable_and_reset_display(port) != 1 ||
+        device_start(&devices[i], i, port, process_command) == -1) {
+      SDL_LogCritical(SDL_LOG_CATEGORY_ERROR, "Cannot start device %s",
+                      names[i]);
+      close_serial_port(port);
+      run = QUIT;
+      break;
+    }
+    started++;
+  }
+
+  initialize_game_controllers();
+
+  if (conf->low_power_idle)
+    idle_enable();
+
+  while (run == RUN) {
+    input_msg_s input = get_input_msg(conf);
+
+    int message = send_input(input, devices[focused].port, &prev_input,
+                             &prev_note);
+    if (message == msg_focus_device || message == msg_next_device) {
+      int next = message == msg_focus_device ? input.value2
+                                             : (focused + 1) % count;
+      if (next != focused) {
+        // Release the keys held on the device losing the focus
+        if (devices[focused].port != NULL)
+          send_msg_controller(devices[focused].port, 0);
+        focused = next;
+        render_set_focus(focused);
+      }
+    }
+
+    // The focused device goes last so that its screen stays selected for
+    // the keyjazz overlay, the speech reads a copy taken by render_screen
+    for (int i = 0; i < count; i++) {
+      if (i != focused && devices[i].port != NULL)
+        process_device(&devices[i], serial_buf);
+    }
+    if (devices[focused].port != NULL)
+      process_device(&devices[focused], serial_buf);
+    render_select_device(focused);
+
+    int connected = 0;
+    for (int i = 0; i < count; i++)
+      connected += devices[i].port != NULL;
+
+    if (connected == 0) {
+      SDL_Log("All devices have disconnected");
+      run = QUIT;
+    }
+
+    if (pacing_enabled()) {
+      if (pacing_frame_due()) {
+        pacing_frame_begin();
+        render_screen();
+        pacing_frame_end();
+      }
+      SDL_Delay(pacing_sleep_ms(conf->idle_ms));
+    } else {
+      render_screen();
+      idle_wait(conf->idle_ms, conf->idle_ms * 4);
+    }
+  }
+
+  SDL_Log("Shutting down\n");
+  for (int i = 0; i < started; i++) {
+    device_stop(&devices[i]);
+    close_serial_port(devices[i].port);
+  }
+  close_game_controllers();
+  close_renderer();
+  pacing_report();
+  idle_report();
+  SDL_Quit();
+  return 0;
+}
+
 int main(int argc, char *argv[]) {
+  const char *record_filename = NULL;
+  const char *replay_filename = NULL;
+  float replay_speed = 1;
+  int headless = 0;
+  int frame_hash = 0;
+  const char *dump_dir = NULL;
+  int stats_dump = 0;
+  int stats_overlay = 0;
+  int latency_samples = 0;
+  const char *port_names[max_devices];
+  char found_names[max_devices][serial_port_name_length];
+  int port_count = 0;
+  int all_devices = 0;
+  const char *shm_name = NULL;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+      record_filename = argv[++i];
+    } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+      replay_filename = argv[++i];
+    } else if (strcmp(argv[i], "--speed") == 0 && i + 1 < argc) {
+      replay_speed = SDL_atof(argv[++i]);
+      if (replay_speed <= 0) {
+        print_usage(argv[0]);
+        return -1;
+      }
+    } else if (strcmp(argv[i], "--max") == 0) {
+      replay_speed = 0;
+    } else if (strcmp(argv[i], "--headless") == 0) {
+      headless = 1;
+    } else if (strcmp(argv[i], "--frame-hash") == 0) {
+      headless = 1;
+      frame_hash = 1;
+    } else if (strcmp(argv[i], "--dump-frames") == 0 && i + 1 < argc) {
+      headless = 1;
+      dump_dir = argv[++i];
+    } else if (strcmp(argv[i], "--stats") == 0) {
+      stats_dump = 1;
+    } else if (strcmp(argv[i], "--stats-overlay") == 0) {
+      stats_overlay = 1;
+    } else if (strcmp(argv[i], "--latency") == 0 && i + 1 < argc) {
+      latency_samples = SDL_atoi(argv[++i]);
+      if (latency_samples <= 0) {
+        print_usage(argv[0]);
+        return -1;
+      }
+    } else if (strcmp(argv[i], "--port") == 0 && i + 1 < argc &&
+               port_count < max_devices) {
+      port_names[port_count++] = argv[++i];
+    } else if (strcmp(argv[i], "--all-devices") == 0) {
+      all_devices = 1;
+    } else if (strcmp(argv[i], "--shm") == 0 && i + 1 < argc) {
+      shm_name = argv[++i];
+    } else {
+      print_usage(argv[0]);
+      return -1;
+    }
+  }
+
+  if (all_devices) {
+    port_count = list_m8_ports(found_names, max_devices);
+    if (port_count == 0) {
+      SDL_LogCritical(SDL_LOG_CATEGORY_SYSTEM, "Cannot find a M8.\n");
+      return -1;
+    }
+    for (int i = 0; i < port_count; i++)
+      port_names[i] = found_names[i];
+  }
+
+  if (port_count > 1 &&
+      (record_filename != NULL || replay_filename != NULL || headless ||
+       shm_name != NULL || latency_samples > 0)) {
+    SDL_LogCritical(SDL_LOG_CATEGORY_SYSTEM,
+                    "--record, --replay, --headless, --shm and --latency work "
+                    "with a single device only\n");
+    print_usage(argv[0]);
+    return -1;
+  }
+
+  if (port_count == 1)
+    set_serial_port_name(port_names[0]);
+
+  int replaying = replay_filename != NULL;
+
   // Initialize the config to defaults read in the params from the
   // configfile if present
   config_params_s conf = init_config();
@@ -42,6 +358,23 @@ int main(int argc, char *argv[]) {
   // TODO: take cli parameter to override default configfile location
   read_config(&conf);
 
+  // Installed before any device is opened, so that an interrupt still shuts
+  // the devices down and turns off their remote display
+  signal(SIGINT, intHandler);
+  signal(SIGTERM, intHandler);
+
+  if (port_count > 1)
+    return run_devices(&conf, port_names, port_count, stats_dump,
+                       stats_overlay);
+
+  if (replaying) {
+    if (replay_open(replay_filename, replay_speed) == -1)
+      return -1;
+  } else if (record_filename != NULL) {
+    if (record_open(record_filename) == -1)
+      return -1;
+  }
+
   // allocate memory for serial buffer
   uint8_t *serial_buf = malloc(serial_read_size);
 
@@ -61,14 +394,12 @@ int main(int argc, char *argv[]) {
   uint8_t prev_input = 0;
   uint8_t prev_note = 0;
   uint16_t zerobyte_packets = 0; // used to detect device disconnection
-
-  signal(SIGINT, intHandler);
-  signal(SIGTERM, intHandler);
+  uint32_t slept_ms = 0;         // length of the last main loop sleep
 
   slip_init(&slip, &slip_descriptor);
 
   // First device detection to avoid SDL init if it isn't necessary
-  if (conf.wait_for_device == 0) {
+  if (conf.wait_for_device == 0 && !replaying) {
     port = init_serial(1);
     if (port == NULL) {
       free(serial_buf);
@@ -77,7 +408,34 @@ int main(int argc, char *argv[]) {
   }
 
   // initialize all SDL systems
-  if (initialize_sdl(conf.init_fullscreen, conf.init_use_gpu) == -1)
+  if (headless) {
+    if (initialize_headless(frame_hash, dump_dir) == -1)
+      run = QUIT;
+  } else {
+    // Paced presents wait for the vertical blank
+    if (conf.frame_pacing)
+      SDL_SetHint(SDL_HINT_RENDER_VSYNC, "1");
+    if (initialize_sdl(conf.init_fullscreen, conf.init_use_gpu) == -1)
+      run = QUIT;
+  }
+
+  // An unpaced replay runs as fast as possible, don't wait for the display
+  if (conf.frame_pacing && !headless && (!replaying || replay_speed > 0)) {
+    int vsync;
+    int refresh_rate = get_display_refresh(&vsync);
+    pacing_enable(refresh_rate, vsync);
+  }
+
+  if (stats_dump || stats_overlay)
+    stats_enable(stats_overlay, stats_dump ? 5000 : 0);
+
+  if (latency_samples > 0 && !replaying)
+    latency_enable(latency_samples);
+
+  if (conf.low_power_idle && !headless && !replaying)
+    idle_enable();
+
+  if (shm_name != NULL && shm_export_open(shm_name) == -1)
     run = QUIT;
 
   // initial scan for (existing) game controllers
@@ -87,9 +445,13 @@ int main(int argc, char *argv[]) {
   SDL_LogSetAllPriority(SDL_LOG_PRIORITY_DEBUG);
 #endif
 
+  // A replay runs straight away without a device
+  if (replaying && run == WAIT_FOR_DEVICE)
+    run = RUN;
+
   // main loop begin
   do {
-    if (port == NULL)
+    if (port == NULL && !replaying)
       port = init_serial(1);
     if (port != NULL) {
       int result;
@@ -104,7 +466,7 @@ int main(int argc, char *argv[]) {
     }
 
     // wait until device is connected
-    if (conf.wait_for_device) {
+    if (conf.wait_for_device && !replaying) {
       static uint32_t ticks_poll_device = 0;
       static uint32_t ticks_update_screen = 0;
 
@@ -119,7 +481,9 @@ int main(int argc, char *argv[]) {
           run = QUIT;
         }
 
-        if (SDL_GetTicks() - ticks_update_screen > 16) {
+        // The screensaver runs slowly when nobody is around
+        if (SDL_GetTicks() - ticks_update_screen >
+            (idle_is_idle() ? screensaver_idle_ms : 16)) {
           ticks_update_screen = SDL_GetTicks();
           screensaver_draw();
           render_screen();
@@ -130,6 +494,7 @@ int main(int argc, char *argv[]) {
           ticks_poll_device = SDL_GetTicks();
           port = init_serial(0);
           if (run == WAIT_FOR_DEVICE && port != NULL) {
+            idle_activity();
             int result = enable_and_reset_display(port);
             SDL_Delay(100);
             // Device was found; enable display and proceed to the main loop
@@ -144,12 +509,12 @@ int main(int argc, char *argv[]) {
           }
         }
 
-        SDL_Delay(conf.idle_ms);
+        idle_wait(conf.idle_ms, screensaver_idle_ms);
       }
 
     } else {
       // classic startup behaviour, exit if device is not found
-      if (port == NULL) {
+      if (port == NULL && !replaying) {
         close_game_controllers();
         close_renderer();
         SDL_Quit();
@@ -164,46 +529,23 @@ int main(int argc, char *argv[]) {
       // get current inputs
       input_msg_s input = get_input_msg(&conf);
 
-      switch (input.type) {
-      case normal:
-        if (input.value != prev_input) {
-          prev_input = input.value;
-          send_msg_controller(port, input.value);
-        }
-        break;
-      case keyjazz:
-        if (input.value != 0) {
-          if (input.eventType == SDL_KEYDOWN && input.value != prev_input) {
-            send_msg_keyjazz(port, input.value, input.value2);
-            prev_note = input.value;
-          } else if (input.eventType == SDL_KEYUP && input.value == prev_note) {
-            send_msg_keyjazz(port, 0xFF, 0);
-          }
-        }
-        prev_input = input.value;
-        break;
-      case special:
-        if (input.value != prev_input) {
-          prev_input = input.value;
-          switch (input.value) {
-          case msg_quit:
-            SDL_Log("Received msg_quit from input device.");
-            run = 0;
-            break;
-          case msg_reset_display:
-            reset_display(port);
-            break;
-          default:
-            break;
-          }
-          break;
-        }
+      send_input(input, port, &prev_input, &prev_note);
+
+      // inject the key presses of a latency measurement
+      if (latency_enabled() && port != NULL) {
+        uint8_t latency_input;
+        if (latency_poll(&latency_input))
+          send_msg_controller(port, latency_input);
+        if (latency_done())
+          run = QUIT;
       }
 
+      if (replaying)
+        replay_advance(conf.idle_ms);
+
       while (1) {
         // read serial port
-        int bytes_read =
-            sp_nonblocking_read(port, serial_buf, serial_read_size);
+        int bytes_read = read_serial(port, serial_buf, replaying);
         if (bytes_read < 0) {
           SDL_LogCritical(SDL_LOG_CATEGORY_ERROR, "Error %d reading serial. \n",
                           (int)bytes_read);
@@ -213,22 +555,35 @@ int main(int argc, char *argv[]) {
           // input from device: reset the zero byte counter and create a
           // pointer to the serial buffer
           zerobyte_packets = 0;
+          idle_activity();
           uint8_t *cur = serial_buf;
           const uint8_t *end = serial_buf + bytes_read;
+          stats_begin();
           while (cur < end) {
             // process the incoming bytes into commands and draw them
             int n = slip_read_byte(&slip, *(cur++));
             if (n != SLIP_NO_ERROR) {
               if (n == SLIP_ERROR_INVALID_PACKET) {
-                reset_display(port);
+                if (port != NULL)
+                  reset_display(port);
               } else {
                 SDL_LogError(SDL_LOG_CATEGORY_ERROR, "SLIP error %d\n", n);
               }
             }
           }
+          stats_end(stats_slip_decode);
+        } else if (replaying) {
+          // nothing due yet, stop when the whole recording has been played
+          if (replay_finished())
+            run = QUIT;
+          break;
         } else {
-          // zero byte packet, increment counter
-          zerobyte_packets++;
+          // zero byte packet, increment counter. Longer idle sleeps count as
+          // several packets so disconnects are noticed as quickly.
+          if (conf.idle_ms > 0 && slept_ms > (uint32_t)conf.idle_ms)
+            zerobyte_packets += slept_ms / conf.idle_ms;
+          else
+            zerobyte_packets++;
           if (zerobyte_packets > conf.wait_packets) {
             zerobyte_packets = 0;
 
@@ -248,8 +603,22 @@ int main(int argc, char *argv[]) {
           break;
         }
       }
-      render_screen();
-      SDL_Delay(conf.idle_ms);
+      if (pacing_enabled()) {
+        // render once per display refresh, the serial port is read until
+        // the frame is due
+        if (pacing_frame_due()) {
+          pacing_frame_begin();
+          render_screen();
+          pacing_frame_end();
+        }
+        SDL_Delay(pacing_sleep_ms(conf.idle_ms));
+      } else {
+        render_screen();
+
+        // an unpaced replay runs flat out
+        if (!replaying || replay_speed > 0)
+          slept_ms = idle_wait(conf.idle_ms, conf.idle_ms * 4);
+      }
     }
   } while (run > QUIT);
   // main loop end
@@ -258,7 +627,13 @@ int main(int argc, char *argv[]) {
   SDL_Log("Shutting down\n");
   close_game_controllers();
   close_renderer();
+  latency_report();
+  pacing_report();
+  idle_report();
+  shm_export_close();
   close_serial_port(port);
+  record_close();
+  replay_close();
   free(serial_buf);
   SDL_Quit();
   return 0;
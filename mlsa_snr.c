@@ -0,0 +1,180 @@
+// Checks the single precision (CST_CG_FLOAT) and fixed point (CST_CG_FIXED)
+// builds of the CG vocoder against the double precision one.
+//
+// flite/src/cg/cst_mlsa.c is compiled once per build, with mlsa_resynthesis
+// renamed for each, see the mlsa_snr target in the Makefile. A fixed
+// utterance, an f0 contour and mel cepstra that change like speech, is
+// vocoded by each, with and without mixed excitation, and the signal to
+// noise ratio of every build against the double one has to stay above a
+// floor.
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "flite/include/cst_cg.h"
+
+#define frame_count 2000
+#define mcep_count 25
+#define me_bands 5
+#define me_order 48
+
+typedef cst_wave *(*resynthesis_func)(const cst_track *params,
+                                      const cst_track *str, cst_cg_db *cg_db,
+                                      cst_audio_streaming_info *asi,
+                                      int mlsa_speed_param);
+
+cst_wave *mlsa_resynthesis_double(const cst_track *params,
+                                  const cst_track *str, cst_cg_db *cg_db,
+                                  cst_audio_streaming_info *asi,
+                                  int mlsa_speed_param);
+cst_wave *mlsa_resynthesis_float(const cst_track *params, const cst_track *str,
+                                 cst_cg_db *cg_db,
+                                 cst_audio_streaming_info *asi,
+                                 int mlsa_speed_param);
+cst_wave *mlsa_resynthesis_fixed(const cst_track *params, const cst_track *str,
+                                 cst_cg_db *cg_db,
+                                 cst_audio_streaming_info *asi,
+                                 int mlsa_speed_param);
+
+typedef struct build_s {
+  const char *name;
+  resynthesis_func resynthesis;
+  double min_snr; // dB against the double build
+} build_s;
+
+// About 84-89 and 57-59 dB when they were added
+static const build_s builds[] = {
+    {"float", mlsa_resynthesis_float, 75},
+    {"fixed", mlsa_resynthesis_fixed, 45},
+};
+
+static uint32_t random_state = 1;
+
+static double next_random() {
+  random_state = random_state * 1103515245 + 12345;
+  return ((random_state >> 8) & 0xffff) / 65536.0 - 0.5;
+}
+
+// 5ms frames of f0 and mel cepstra. Every fourth 300ms is unvoiced.
+static cst_track *make_params() {
+  cst_track *params = new_track();
+  double smoothed[mcep_count + 1] = {0};
+
+  cst_track_resize(params, frame_count, mcep_count + 1);
+  for (int i = 0; i < frame_count; i++) {
+    params->times[i] = i * 0.005;
+    params->frames[i][0] = (i / 60) % 4 == 3 ? 0 : 110 + 20 * sin(i * 0.02);
+    params->frames[i][1] = 5.5 + 1.5 * sin(i * 0.013);
+    for (int k = 2; k <= mcep_count; k++) {
+      smoothed[k] = 0.95 * smoothed[k] + 0.1 * next_random() / k;
+      params->frames[i][k] = smoothed[k] + (k == 2 ? 0.8 * sin(i * 0.03) : 0);
+    }
+  }
+  return params;
+}
+
+// Band voicing strengths for the mixed excitation
+static cst_track *make_strengths() {
+  cst_track *str = new_track();
+
+  cst_track_resize(str, frame_count, me_bands);
+  for (int i = 0; i < frame_count; i++) {
+    str->times[i] = i * 0.005;
+    for (int b = 0; b < me_bands; b++)
+      str->frames[i][b] = 0.5 + 0.5 * sin(i * 0.01 + b);
+  }
+  return str;
+}
+
+// Low pass filter with the cutoff as a fraction of the sample rate, at time t
+static double low_pass(double cutoff, double t) {
+  return t == 0 ? 2 * cutoff : sin(2 * M_PI * cutoff * t) / (M_PI * t);
+}
+
+// Windowed sinc band pass filters splitting 0..8kHz into the bands
+static double **make_band_filters() {
+  double **h = malloc(me_bands * sizeof(double *));
+
+  for (int b = 0; b < me_bands; b++) {
+    double low = 0.5 * b / me_bands, high = 0.5 * (b + 1) / me_bands;
+    h[b] = malloc(me_order * sizeof(double));
+    for (int n = 0; n < me_order; n++) {
+      double t = n - (me_order - 1) / 2.0;
+      double window = 0.54 - 0.46 * cos(2 * M_PI * n / (me_order - 1));
+      h[b][n] = window * (low_pass(high, t) - low_pass(low, t));
+    }
+  }
+  return h;
+}
+
+static double snr(const cst_wave *reference, const cst_wave *wave) {
+  double signal = 0, noise = 0;
+
+  for (int i = 0; i < reference->num_samples; i++) {
+    double difference = reference->samples[i] - wave->samples[i];
+    signal += (double)reference->samples[i] * reference->samples[i];
+    noise += difference * difference;
+  }
+  // A silent reference would pass anything
+  if (signal == 0)
+    return -INFINITY;
+  return noise > 0 ? 10 * log10(signal / noise) : INFINITY;
+}
+
+// Vocodes the utterance with every build, returns the number of failures
+static int check(const char *label, const cst_track *params,
+                 const cst_track *str, cst_cg_db *cg_db) {
+  int failures = 0;
+  // The mixed excitation noise comes from rand(), so each build is given the
+  // same sequence
+  srand(1);
+  cst_wave *reference = mlsa_resynthesis_double(params, str, cg_db, NULL, 0);
+
+  for (size_t i = 0; i < sizeof(builds) / sizeof(builds[0]); i++) {
+    srand(1);
+    cst_wave *wave = builds[i].resynthesis(params, str, cg_db, NULL, 0);
+    int failed = wave->num_samples != reference->num_samples;
+    double ratio = failed ? -INFINITY : snr(reference, wave);
+
+    failed = failed || ratio < builds[i].min_snr;
+    printf("%-18s %s: %.1f dB, at least %.0f dB: %s\n", label, builds[i].name,
+           ratio, builds[i].min_snr, failed ? "FAILED" : "ok");
+    failures += failed;
+    delete_wave(wave);
+  }
+
+  delete_wave(reference);
+  return failures;
+}
+
+int main() {
+  cst_cg_db cg_db;
+  cst_track *params = make_params();
+  cst_track *str = make_strengths();
+  double **band_filters = make_band_filters();
+  int failures = 0;
+
+  memset(&cg_db, 0, sizeof(cg_db));
+  cg_db.sample_rate = 16000;
+  cg_db.mlsa_alpha = 0.42;
+  cg_db.gain = 1.0;
+
+  failures += check("pulse excitation", params, NULL, &cg_db);
+
+  cg_db.mixed_excitation = 1;
+  cg_db.ME_num = me_bands;
+  cg_db.ME_order = me_order;
+  cg_db.me_h = (const double *const *)band_filters;
+  failures += check("mixed excitation", params, str, &cg_db);
+
+  for (int b = 0; b < me_bands; b++)
+    free(band_filters[b]);
+  free(band_filters);
+  delete_track(str);
+  delete_track(params);
+
+  return failures == 0 ? 0 : 1;
+}
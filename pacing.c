@@ -0,0 +1,132 @@
+// Presents frames in step with the display refresh instead of once per main
+// loop iteration. Each frame is presented just before the vblank it aims
+// for, so serial data that arrives until then still makes it into the frame.
+// With vsync the refresh interval and phase are learned from the times the
+// presents return, without it the display mode refresh rate is used.
+
+#include "pacing.h"
+
+#include <SDL.h>
+
+#define pacing_min_margin_us 1000 // always start rendering this early at least
+#define pacing_learn_rate 0.05
+
+static int enabled = 0;
+static int has_vsync;
+static double counter_to_us;
+static double interval_us; // refresh interval
+static double render_us;   // average time from frame start to present
+
+static uint64_t last_vblank;   // counter value of the last known vblank
+static uint64_t target_vblank; // vblank the next frame is presented at
+static uint64_t deadline;      // when rendering of the next frame starts
+static uint64_t frame_start;
+static uint64_t present_start;
+static int presented;
+
+static uint32_t frames_presented = 0;
+static uint32_t frames_unchanged = 0;
+static uint32_t deadlines_missed = 0;
+
+static uint64_t us_to_counter(double us) {
+  return (uint64_t)(us / counter_to_us);
+}
+
+// Picks the first vblank that can still be reached with the render margin
+static void schedule(uint64_t now) {
+  uint64_t margin = us_to_counter(render_us + pacing_min_margin_us);
+  uint64_t interval = us_to_counter(interval_us);
+
+  uint64_t vblanks = 1;
+  if (now + margin > last_vblank)
+    vblanks += (now + margin - last_vblank) / interval;
+
+  target_vblank = last_vblank + vblanks * interval;
+  deadline = target_vblank - margin;
+}
+
+void pacing_enable(int refresh_rate, int vsync) {
+  enabled = 1;
+  has_vsync = vsync;
+  counter_to_us = 1000000.0 / SDL_GetPerformanceFrequency();
+  interval_us = 1000000.0 / (refresh_rate > 0 ? refresh_rate : 60);
+  render_us = 0;
+  last_vblank = SDL_GetPerformanceCounter();
+  schedule(last_vblank);
+
+  SDL_Log("Frame pacing at %d Hz%s", refresh_rate > 0 ? refresh_rate : 60,
+          vsync ? " with vsync" : "");
+}
+
+int pacing_enabled() { return enabled; }
+
+int pacing_frame_due() { return SDL_GetPerformanceCounter() >= deadline; }
+
+uint32_t pacing_sleep_ms(uint32_t max_ms) {
+  uint64_t now = SDL_GetPerformanceCounter();
+  if (now >= deadline)
+    return 0;
+
+  double ms = (deadline - now) * counter_to_us / 1000;
+  return ms < max_ms ? (uint32_t)ms : max_ms;
+}
+
+void pacing_frame_begin() {
+  frame_start = SDL_GetPerformanceCounter();
+  presented = 0;
+}
+
+void pacing_present_begin() {
+  if (enabled)
+    present_start = SDL_GetPerformanceCounter();
+}
+
+void pacing_presented() {
+  if (!enabled)
+    return;
+
+  uint64_t now = SDL_GetPerformanceCounter();
+  presented = 1;
+  frames_presented++;
+
+  double render = (present_start - frame_start) * counter_to_us;
+  render_us += (render - render_us) * pacing_learn_rate;
+
+  if (now > target_vblank + us_to_counter(interval_us / 2))
+    deadlines_missed++;
+
+  if (has_vsync) {
+    // The present returned at a vblank, learn the interval from the
+    // presents that land on expected vblanks
+    double elapsed = (now - last_vblank) * counter_to_us;
+    int vblanks = (int)(elapsed / interval_us + 0.5);
+    if (vblanks > 0) {
+      double measured = elapsed / vblanks;
+      if (measured > interval_us * 0.9 && measured < interval_us * 1.1)
+        interval_us += (measured - interval_us) * pacing_learn_rate;
+    }
+    last_vblank = now;
+  } else {
+    last_vblank = target_vblank;
+  }
+}
+
+void pacing_frame_end() {
+  if (!presented) {
+    // Nothing changed, stay on the predicted vblank grid
+    frames_unchanged++;
+    last_vblank = target_vblank;
+  }
+
+  schedule(SDL_GetPerformanceCounter());
+}
+
+void pacing_report() {
+  if (!enabled)
+    return;
+
+  SDL_Log("Frame pacing: %u frames presented, %u unchanged, %u missed "
+          "deadlines, refresh %.2f Hz, render %.2f ms",
+          frames_presented, frames_unchanged, deadlines_missed,
+          1000000.0 / interval_us, render_us / 1000);
+}
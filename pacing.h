@@ -0,0 +1,20 @@
+#ifndef PACING_H_
+#define PACING_H_
+
+#include <stdint.h>
+
+void pacing_enable(int refresh_rate, int vsync);
+int pacing_enabled();
+
+// Main loop side: is it time to render, and how long it can sleep until then
+int pacing_frame_due();
+uint32_t pacing_sleep_ms(uint32_t max_ms);
+void pacing_frame_begin();
+void pacing_frame_end();
+void pacing_report();
+
+// Hooks called by the renderer around SDL_RenderPresent
+void pacing_present_begin();
+void pacing_presented();
+
+#endif
@@ -0,0 +1,271 @@
+// Pronunciation dictionary for the flow mode guidance. The M8 screen is full
+// of abbreviations that the speech synthesizer reads badly, so they are
+// replaced by spoken forms before synthesis. The built in entries can be
+// extended and overridden with a file in the preferences directory, one
+// "KEY=Spoken form" per line. Keys can be several words long.
+//
+// The keys are compiled into a trie, and the text is rewritten in a single
+// pass with the longest key matching at each word.
+
+#include "pronounce.h"
+
+#include <SDL.h>
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define max_line_length 256
+
+static const char *default_entries[][2] = {
+    {"INST.", "Instrument"},
+    {"MACROSYN", "Macro synth"},
+    {"-", "NO VALUE"},
+    {"--", "NO VALUE"},
+    {"---", "NO VALUE"},
+    {"PH", "Phrase"},
+    {"TSP", "Transpose"},
+    {"N", "Note"},
+    {"V", "Velocity"},
+    {"I", "Instrument"},
+    {"TRANSP.", "Transpose"},
+    {"RES", "Resonance"},
+    {"AMP", "Amplification"},
+    {"LIM", "Limit"},
+    {"CHO", "Chorus"},
+    {"DEL", "Delay"},
+    {"REV", "Reverb"},
+    {"OUTPUT VOL", "Output Volume"},
+    {"SPEAKER VOL", "Speaker Volume"},
+    {"WAV", "Wave"},
+};
+
+// Children of a node are a linked list of siblings. Words in a key are
+// separated by a single ' ' node.
+typedef struct trie_node_s {
+  char c;
+  int first_child;
+  int next_sibling;
+  char *replacement; // set when a key ends at this node
+} trie_node_s;
+
+static trie_node_s *nodes = NULL;
+static int node_count = 0;
+static int node_capacity = 0;
+
+static int new_node(char c) {
+  if (node_count == node_capacity) {
+    int capacity = node_capacity ? node_capacity * 2 : 256;
+    trie_node_s *grown = realloc(nodes, capacity * sizeof(trie_node_s));
+    if (grown == NULL)
+      return -1;
+    nodes = grown;
+    node_capacity = capacity;
+  }
+
+  nodes[node_count] = (trie_node_s){c, -1, -1, NULL};
+  return node_count++;
+}
+
+static int find_child(int node, char c) {
+  for (int child = nodes[node].first_child; child != -1;
+       child = nodes[child].next_sibling) {
+    if (nodes[child].c == c)
+      return child;
+  }
+  return -1;
+}
+
+// Adds or replaces an entry. The key is matched with its exact case, so "I"
+// doesn't rewrite a lowercase "i", and any run of whitespace in it matches
+// any run of whitespace in the text.
+static int add_entry(const char *key, const char *replacement) {
+  if (node_count == 0 && new_node(0) == -1)
+    return -1;
+
+  int node = 0;
+  while (isspace((unsigned char)*key))
+    key++;
+
+  while (*key) {
+    char c = *key++;
+    if (isspace((unsigned char)c)) {
+      while (isspace((unsigned char)*key))
+        key++;
+      if (*key == '\0')
+        break;
+      c = ' ';
+    }
+
+    int child = find_child(node, c);
+    if (child == -1) {
+      child = new_node(c);
+      if (child == -1)
+        return -1;
+      nodes[child].next_sibling = nodes[node].first_child;
+      nodes[node].first_child = child;
+    }
+    node = child;
+  }
+
+  if (node == 0)
+    return -1;
+
+  char *copy = strdup(replacement);
+  if (copy == NULL)
+    return -1;
+  free(nodes[node].replacement);
+  nodes[node].replacement = copy;
+  return 1;
+}
+
+static void write_default_file(const char *filename) {
+  FILE *file = fopen(filename, "w");
+  if (file == NULL)
+    return;
+
+  fprintf(file, "; flow mode pronunciations, one KEY=Spoken form per line\n");
+  for (size_t i = 0; i < sizeof(default_entries) / sizeof(default_entries[0]);
+       i++)
+    fprintf(file, "%s=%s\n", default_entries[i][0], default_entries[i][1]);
+
+  fclose(file);
+}
+
+// Compiles the built in entries and the entries of the file. The file is
+// created with the built in entries if it doesn't exist.
+int pronounce_load(const char *filename) {
+  for (size_t i = 0; i < sizeof(default_entries) / sizeof(default_entries[0]);
+       i++) {
+    if (add_entry(default_entries[i][0], default_entries[i][1]) == -1)
+      return -1;
+  }
+
+  FILE *file = fopen(filename, "r");
+  if (file == NULL) {
+    write_default_file(filename);
+    return 1;
+  }
+
+  char line[max_line_length];
+  int line_number = 0;
+  while (fgets(line, sizeof(line), file) != NULL) {
+    line_number++;
+    line[strcspn(line, "\r\n")] = '\0';
+
+    if (line[0] == ';' || line[0] == '#' || line[0] == '\0')
+      continue;
+
+    char *separator = strchr(line, '=');
+    if (separator == NULL) {
+      SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "%s:%d: missing '='",
+                  filename, line_number);
+      continue;
+    }
+
+    *separator = '\0';
+
+    char *replacement = separator + 1;
+    while (isspace((unsigned char)*replacement))
+      replacement++;
+    char *end = replacement + strlen(replacement);
+    while (end > replacement && isspace((unsigned char)end[-1]))
+      *--end = '\0';
+
+    if (add_entry(line, replacement) == -1)
+      SDL_LogWarn(SDL_LOG_CATEGORY_APPLICATION, "%s:%d: invalid entry",
+                  filename, line_number);
+  }
+
+  fclose(file);
+  return 1;
+}
+
+// Appends to a fixed size buffer, silently truncating
+typedef struct text_builder_s {
+  char *buf;
+  size_t size;
+  size_t length;
+} text_builder_s;
+
+static void append(text_builder_s *builder, const char *text, size_t length) {
+  if (builder->length + length >= builder->size)
+    length = builder->size - builder->length - 1;
+  memcpy(builder->buf + builder->length, text, length);
+  builder->length += length;
+  builder->buf[builder->length] = '\0';
+}
+
+// Two character hex numbers like "FE" are spelled out, otherwise they are
+// read as words
+static int is_hex_word(const char *word, size_t length) {
+  return length == 2 && isxdigit((unsigned char)word[0]) &&
+         isxdigit((unsigned char)word[1]) &&
+         (isalpha((unsigned char)word[0]) || isalpha((unsigned char)word[1]));
+}
+
+// Rewrites text word by word into out. Every word is followed by a space.
+void pronounce_text(const char *text, char *out, size_t size) {
+  text_builder_s builder = {out, size, 0};
+
+  if (size == 0)
+    return;
+  out[0] = '\0';
+
+  const char *p = text;
+  while (1) {
+    while (isspace((unsigned char)*p))
+      p++;
+    if (*p == '\0')
+      break;
+
+    // Longest key starting here that ends at the end of a word
+    const char *replacement = NULL;
+    const char *match_end = NULL;
+    if (node_count > 0) {
+      int node = 0;
+      const char *q = p;
+      while (*q) {
+        char c = *q;
+        if (isspace((unsigned char)c))
+          c = ' ';
+
+        node = find_child(node, c);
+        if (node == -1)
+          break;
+
+        if (c == ' ') {
+          while (isspace((unsigned char)*q))
+            q++;
+        } else {
+          q++;
+        }
+
+        if (c != ' ' && nodes[node].replacement != NULL &&
+            (*q == '\0' || isspace((unsigned char)*q))) {
+          replacement = nodes[node].replacement;
+          match_end = q;
+        }
+      }
+    }
+
+    if (replacement != NULL) {
+      append(&builder, replacement, strlen(replacement));
+      p = match_end;
+    } else {
+      const char *word_end = p;
+      while (*word_end && !isspace((unsigned char)*word_end))
+        word_end++;
+
+      if (is_hex_word(p, word_end - p)) {
+        char letters[3] = {p[0], ' ', p[1]};
+        append(&builder, letters, sizeof(letters));
+      } else {
+        append(&builder, p, word_end - p);
+      }
+      p = word_end;
+    }
+
+    append(&builder, " ", 1);
+  }
+}
@@ -0,0 +1,9 @@
+#ifndef PRONOUNCE_H_
+#define PRONOUNCE_H_
+
+#include <stddef.h>
+
+int pronounce_load(const char *filename);
+void pronounce_text(const char *text, char *out, size_t size);
+
+#endif
@@ -0,0 +1,204 @@
+// CPU rasterizer for the M8 draw commands. Draws straight into a 320x240
+// ARGB8888 framebuffer, which the renderer uploads once per frame. Used
+// instead of the SDL software renderer when the GPU is not in use.
+
+#include "raster.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "inline_font.h"
+
+#define glyph_count 128
+#define glyph_size 8
+
+// Text is drawn with a background box narrower than the glyph, like inprint
+#define glyph_background_width 6
+
+// Glyph rows as bitmasks, bit 0 = leftmost pixel, set = foreground
+static uint8_t glyph_rows[glyph_count][glyph_size];
+
+// Every possible glyph row expanded into per-pixel masks
+static uint32_t row_masks[256][glyph_size];
+
+void raster_init() {
+  const int bytes_per_row = inline_font_width / 8;
+  const int glyphs_per_row = inline_font_width / glyph_size;
+
+  // The font bitmap has the glyph pixels as cleared bits
+  for (int c = 0; c < glyph_count; c++) {
+    int first_row = (c / glyphs_per_row) * glyph_size;
+    for (int row = 0; row < glyph_size; row++)
+      glyph_rows[c][row] = ~inline_font_bits[(first_row + row) * bytes_per_row +
+                                             c % glyphs_per_row];
+  }
+
+  for (int bits = 0; bits < 256; bits++) {
+    for (int i = 0; i < glyph_size; i++)
+      row_masks[bits][i] = (bits >> i) & 1 ? 0xFFFFFFFF : 0;
+  }
+}
+
+static inline void fill_row(uint32_t *dst, int count, uint32_t color) {
+  int i = 0;
+#if defined(__SSE2__)
+  __m128i fill = _mm_set1_epi32(color);
+  for (; i + 8 <= count; i += 8) {
+    _mm_storeu_si128((__m128i *)(dst + i), fill);
+    _mm_storeu_si128((__m128i *)(dst + i + 4), fill);
+  }
+#elif defined(__ARM_NEON)
+  uint32x4_t fill = vdupq_n_u32(color);
+  for (; i + 8 <= count; i += 8) {
+    vst1q_u32(dst + i, fill);
+    vst1q_u32(dst + i + 4, fill);
+  }
+#endif
+  for (; i < count; i++)
+    dst[i] = color;
+}
+
+void raster_fill_rect(uint32_t *framebuffer, int x, int y, int w, int h,
+                      uint32_t color) {
+  // Clip to the framebuffer
+  if (x < 0) {
+    w += x;
+    x = 0;
+  }
+  if (y < 0) {
+    h += y;
+    y = 0;
+  }
+  if (x + w > raster_width)
+    w = raster_width - x;
+  if (y + h > raster_height)
+    h = raster_height - y;
+  if (w <= 0 || h <= 0)
+    return;
+
+  uint32_t *dst = framebuffer + y * raster_width + x;
+  for (int row = 0; row < h; row++, dst += raster_width)
+    fill_row(dst, w, color);
+}
+
+void raster_character(uint32_t *framebuffer, int c, int x, int y,
+                      uint32_t fgcolor, uint32_t bgcolor, int draw_background) {
+  if (draw_background)
+    raster_fill_rect(framebuffer, x, y, glyph_background_width, glyph_size,
+                     bgcolor);
+
+  if (c < 0 || c >= glyph_count)
+    return;
+
+  if (x >= 0 && y >= 0 && x + glyph_size <= raster_width &&
+      y + glyph_size <= raster_height) {
+    // Fully visible: blend whole rows with the expanded masks
+    uint32_t *dst = framebuffer + y * raster_width + x;
+    for (int row = 0; row < glyph_size; row++, dst += raster_width) {
+      const uint32_t *mask = row_masks[glyph_rows[c][row]];
+      for (int i = 0; i < glyph_size; i++)
+        dst[i] = (dst[i] & ~mask[i]) | (fgcolor & mask[i]);
+    }
+    return;
+  }
+
+  // Partially visible glyph, check every pixel
+  for (int row = 0; row < glyph_size; row++) {
+    if (y + row < 0 || y + row >= raster_height)
+      continue;
+    for (int i = 0; i < glyph_size; i++) {
+      if (x + i >= 0 && x + i < raster_width &&
+          (glyph_rows[c][row] >> i) & 1)
+        framebuffer[(y + row) * raster_width + x + i] = fgcolor;
+    }
+  }
+}
+
+void raster_waveform(uint32_t *framebuffer, const uint8_t *waveform, int size,
+                     uint32_t color) {
+  if (size > raster_width)
+    size = raster_width;
+
+  for (int i = 0; i < size; i++) {
+    if (waveform[i] < raster_height)
+      framebuffer[waveform[i] * raster_width + i] = color;
+  }
+}
+
+// Nearest neighbor horizontal expansion of one framebuffer row
+static void scale_row(const uint32_t *src, int scale, uint32_t *dst) {
+  int i = 0;
+
+  switch (scale) {
+  case 2:
+#if defined(__SSE2__)
+    for (; i < raster_width; i += 4) {
+      __m128i p = _mm_loadu_si128((const __m128i *)(src + i));
+      _mm_storeu_si128((__m128i *)(dst + i * 2), _mm_unpacklo_epi32(p, p));
+      _mm_storeu_si128((__m128i *)(dst + i * 2 + 4), _mm_unpackhi_epi32(p, p));
+    }
+#elif defined(__ARM_NEON)
+    for (; i < raster_width; i += 4) {
+      uint32x4_t p = vld1q_u32(src + i);
+      vst2q_u32(dst + i * 2, (uint32x4x2_t){{p, p}});
+    }
+#endif
+    break;
+  case 3:
+#if defined(__SSE2__)
+    for (; i < raster_width; i += 4) {
+      __m128i p = _mm_loadu_si128((const __m128i *)(src + i));
+      _mm_storeu_si128((__m128i *)(dst + i * 3),
+                       _mm_shuffle_epi32(p, _MM_SHUFFLE(1, 0, 0, 0)));
+      _mm_storeu_si128((__m128i *)(dst + i * 3 + 4),
+                       _mm_shuffle_epi32(p, _MM_SHUFFLE(2, 2, 1, 1)));
+      _mm_storeu_si128((__m128i *)(dst + i * 3 + 8),
+                       _mm_shuffle_epi32(p, _MM_SHUFFLE(3, 3, 3, 2)));
+    }
+#elif defined(__ARM_NEON)
+    for (; i < raster_width; i += 4) {
+      uint32x4_t p = vld1q_u32(src + i);
+      vst3q_u32(dst + i * 3, (uint32x4x3_t){{p, p, p}});
+    }
+#endif
+    break;
+  case 4:
+#if defined(__SSE2__)
+    for (; i < raster_width; i += 4) {
+      __m128i p = _mm_loadu_si128((const __m128i *)(src + i));
+      _mm_storeu_si128((__m128i *)(dst + i * 4), _mm_shuffle_epi32(p, 0x00));
+      _mm_storeu_si128((__m128i *)(dst + i * 4 + 4), _mm_shuffle_epi32(p, 0x55));
+      _mm_storeu_si128((__m128i *)(dst + i * 4 + 8), _mm_shuffle_epi32(p, 0xAA));
+      _mm_storeu_si128((__m128i *)(dst + i * 4 + 12), _mm_shuffle_epi32(p, 0xFF));
+    }
+#elif defined(__ARM_NEON)
+    for (; i < raster_width; i += 4) {
+      uint32x4_t p = vld1q_u32(src + i);
+      vst4q_u32(dst + i * 4, (uint32x4x4_t){{p, p, p, p}});
+    }
+#endif
+    break;
+  }
+
+  // Other scales, and everything when there is no SIMD
+  for (; i < raster_width; i++)
+    fill_row(dst + i * scale, scale, src[i]);
+}
+
+// Upscales framebuffer rows by an integer factor. dst_pitch is in pixels.
+void raster_scale_rows(const uint32_t *src, int rows, int scale, uint32_t *dst,
+                       int dst_pitch) {
+  for (int row = 0; row < rows; row++, src += raster_width) {
+    scale_row(src, scale, dst);
+    // The remaining lines of the row are copies of the first one
+    for (int line = 1; line < scale; line++)
+      memcpy(dst + line * dst_pitch, dst, raster_width * scale * sizeof(uint32_t));
+    dst += dst_pitch * scale;
+  }
+}
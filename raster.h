@@ -0,0 +1,19 @@
+#ifndef RASTER_H_
+#define RASTER_H_
+
+#include <stdint.h>
+
+#define raster_width 320
+#define raster_height 240
+
+void raster_init();
+void raster_fill_rect(uint32_t *framebuffer, int x, int y, int w, int h,
+                      uint32_t color);
+void raster_scale_rows(const uint32_t *src, int rows, int scale, uint32_t *dst,
+                       int dst_pitch);
+void raster_character(uint32_t *framebuffer, int c, int x, int y,
+                      uint32_t fgcolor, uint32_t bgcolor, int draw_background);
+void raster_waveform(uint32_t *framebuffer, const uint8_t *waveform, int size,
+                     uint32_t color);
+
+#endif
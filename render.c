@@ -5,6 +5,8 @@
 
 #include <SDL.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <pthread.h>
 
 #include "SDL2_inprint.h"
@@ -14,6 +16,11 @@
 #include "flite/include/flite.h"
 #include "fx_cube.h"
 #include "flow.h"
+#include "latency.h"
+#include "pacing.h"
+#include "raster.h"
+#include "shm_export.h"
+#include "stats.h"
 
 SDL_Window *win;
 SDL_Renderer *rend;
@@ -29,6 +36,90 @@ uint8_t fullscreen = 0;
 
 static uint8_t dirty = 0;
 
+// Headless mode renders into a plain software surface without a window
+static SDL_Surface *headless_surface = NULL;
+static int headless_frame_hash = 0;
+static const char *headless_dump_dir = NULL;
+static uint32_t headless_frames = 0;
+static uint32_t headless_start_ticks;
+static uint32_t commands_drawn = 0;
+
+// Without the GPU the draw commands are rasterized on the CPU into this
+// framebuffer, which is uploaded to a streaming texture once per frame
+static uint32_t *framebuffer = NULL;
+static SDL_Texture *framebuffer_texture = NULL;
+static int screensaver_active = 0;
+
+// The framebuffer is upscaled by an integer factor into this texture, which
+// is copied to the window without further scaling. Only the framebuffer rows
+// that changed since the last present are upscaled again.
+static SDL_Texture *scaled_texture = NULL;
+static int scaled_factor = 0;
+static int damage_top = 0;
+static int damage_bottom = raster_height;
+
+// The M8 sends oscilloscope packets much faster than the screen refreshes,
+// so they are only kept here and the newest one is drawn at present time
+static struct draw_oscilloscope_waveform_command pending_waveform;
+static int waveform_pending = 0;
+static int waveform_shown = 0;
+static uint32_t waveforms_received = 0;
+static uint32_t waveforms_merged = 0;
+static SDL_Texture *waveform_texture = NULL;
+static uint32_t waveform_pixels[raster_width * 21];
+static uint8_t wfm_cleared = 0;
+
+// When several M8s are shown, the globals above hold the screen of the
+// selected device and the screens of the others are kept here. Selecting a
+// device swaps its screen in, so the drawing code and flow.c don't need to
+// know about devices at all. The screens are shown tiled in the window.
+#define max_screens 8
+
+typedef struct device_screen_s {
+  SDL_Texture *maintexture;
+  uint32_t *framebuffer;
+  SDL_Texture *framebuffer_texture;
+  SDL_Texture *waveform_texture;
+  SDL_Color background_color;
+  char screenbuffer[24][40];
+  char selection_buffer[24][40];
+  int new_selection_row;
+  struct draw_oscilloscope_waveform_command pending_waveform;
+  int waveform_pending;
+  int waveform_shown;
+  uint8_t wfm_cleared;
+  int damage_top;
+  int damage_bottom;
+} device_screen_s;
+
+static device_screen_s device_screens[max_screens];
+static int device_count = 1;
+static int current_device = 0;
+static int focused_device = 0;
+static int tile_columns = 1;
+// Logical size of the window, a grid of 320x240 tiles
+static int logical_width = 320;
+static int logical_height = 240;
+
+static void mark_damaged(int y, int h) {
+  if (y < damage_top)
+    damage_top = y < 0 ? 0 : y;
+  if (y + h > damage_bottom)
+    damage_bottom = y + h > raster_height ? raster_height : y + h;
+}
+
+// Creates the texture the oscilloscope is drawn into. Without it the
+// waveform is drawn onto the screen directly, as each packet used to be.
+static void create_waveform_texture() {
+  waveform_texture = SDL_CreateTexture(rend, SDL_PIXELFORMAT_ARGB8888,
+                                       SDL_TEXTUREACCESS_STREAMING, 320, 21);
+  if (waveform_texture == NULL)
+    SDL_LogError(SDL_LOG_CATEGORY_RENDER,
+                 "Cannot create the oscilloscope texture, drawing it "
+                 "directly: %s",
+                 SDL_GetError());
+}
+
 // Initializes SDL and creates a renderer and required surfaces
 int initialize_sdl(int init_fullscreen, int init_use_gpu) {
   const int window_width = 640;  // SDL window width
@@ -50,7 +141,7 @@ int initialize_sdl(int init_fullscreen, int init_use_gpu) {
   rend = SDL_CreateRenderer(
       win, -1, init_use_gpu ? SDL_RENDERER_ACCELERATED : SDL_RENDERER_SOFTWARE);
 
-  SDL_RenderSetLogicalSize(rend, 320, 240);
+  SDL_RenderSetLogicalSize(rend, logical_width, logical_height);
 
   maintexture = SDL_CreateTexture(rend, SDL_PIXELFORMAT_ARGB8888,
                                   SDL_TEXTUREACCESS_TARGET, 320, 240);
@@ -64,21 +155,153 @@ int initialize_sdl(int init_fullscreen, int init_use_gpu) {
   inrenderer(rend);
   prepare_inline_font();
 
+  if (!init_use_gpu) {
+    framebuffer_texture =
+        SDL_CreateTexture(rend, SDL_PIXELFORMAT_ARGB8888,
+                          SDL_TEXTUREACCESS_STREAMING, 320, 240);
+    framebuffer = calloc(raster_width * raster_height, sizeof(uint32_t));
+    if (framebuffer_texture == NULL || framebuffer == NULL) {
+      SDL_LogError(SDL_LOG_CATEGORY_RENDER,
+                   "Cannot create framebuffer, using the SDL renderer: %s",
+                   SDL_GetError());
+      if (framebuffer_texture != NULL)
+        SDL_DestroyTexture(framebuffer_texture);
+      free(framebuffer);
+      framebuffer_texture = NULL;
+      framebuffer = NULL;
+    } else {
+      raster_init();
+    }
+  }
+
+  if (framebuffer == NULL)
+    create_waveform_texture();
+
+  SDL_LogSetAllPriority(SDL_LOG_PRIORITY_INFO);
+
+  dirty = 1;
+
+  return 1;
+}
+
+// Initializes SDL without video and renders into an offscreen 320x240
+// surface. Frames can be checksummed and/or dumped as BMP files.
+int initialize_headless(int frame_hash, const char *dump_dir) {
+
+  if (SDL_Init(SDL_INIT_TIMER | SDL_INIT_EVENTS) != 0) {
+    SDL_LogCritical(SDL_LOG_CATEGORY_ERROR, "SDL_Init: %s\n", SDL_GetError());
+    return -1;
+  }
+
+  atexit(SDL_Quit);
+
+  headless_surface = SDL_CreateRGBSurfaceWithFormat(0, 320, 240, 32,
+                                                    SDL_PIXELFORMAT_ARGB8888);
+  if (headless_surface == NULL) {
+    SDL_LogCritical(SDL_LOG_CATEGORY_ERROR, "SDL_CreateRGBSurface: %s\n",
+                    SDL_GetError());
+    return -1;
+  }
+
+  // The surface itself is the render target, maintexture stays NULL
+  rend = SDL_CreateSoftwareRenderer(headless_surface);
+
+  SDL_SetRenderDrawColor(rend, 0x00, 0x00, 0x00, 0x00);
+  SDL_RenderClear(rend);
+
+  inrenderer(rend);
+  prepare_inline_font();
+
+  create_waveform_texture();
+
   SDL_LogSetAllPriority(SDL_LOG_PRIORITY_INFO);
 
+  headless_frame_hash = frame_hash;
+  headless_dump_dir = dump_dir;
+  headless_start_ticks = SDL_GetTicks();
+
   dirty = 1;
 
   return 1;
 }
 
 void close_renderer() {
+  // The globals hold the selected device, free the screens of the others
+  for (int i = 0; i < device_count; i++) {
+    device_screen_s *screen = &device_screens[i];
+    if (i == current_device)
+      continue;
+    if (screen->framebuffer_texture != NULL)
+      SDL_DestroyTexture(screen->framebuffer_texture);
+    if (screen->waveform_texture != NULL)
+      SDL_DestroyTexture(screen->waveform_texture);
+    if (screen->maintexture != NULL)
+      SDL_DestroyTexture(screen->maintexture);
+    free(screen->framebuffer);
+  }
+  device_count = 1;
+
+  if (waveforms_received > 0)
+    SDL_Log("Drew %u of %u oscilloscope packets, %u were replaced by a newer "
+            "one before the screen was presented",
+            waveforms_received - waveforms_merged, waveforms_received,
+            waveforms_merged);
+
+  if (waveform_texture != NULL) {
+    SDL_DestroyTexture(waveform_texture);
+    waveform_texture = NULL;
+  }
+
+  if (headless_surface != NULL) {
+    uint32_t elapsed = SDL_GetTicks() - headless_start_ticks;
+    SDL_Log("Rendered %u frames and %u commands in %u ms (%.1f fps, %.1f "
+            "commands/s)",
+            headless_frames, commands_drawn, elapsed,
+            elapsed ? headless_frames * 1000.0f / elapsed : 0,
+            elapsed ? commands_drawn * 1000.0f / elapsed : 0);
+    SDL_DestroyRenderer(rend);
+    SDL_FreeSurface(headless_surface);
+    headless_surface = NULL;
+    return;
+  }
+
+  if (framebuffer != NULL) {
+    if (scaled_texture != NULL)
+      SDL_DestroyTexture(scaled_texture);
+    SDL_DestroyTexture(framebuffer_texture);
+    free(framebuffer);
+    framebuffer = NULL;
+  }
+
   SDL_DestroyTexture(maintexture);
   SDL_DestroyRenderer(rend);
   SDL_DestroyWindow(win);
 }
 
+// Returns the refresh rate of the display the window is on, or 0 if it is
+// not known. vsync is set if presents wait for the vertical blank.
+int get_display_refresh(int *vsync) {
+  SDL_RendererInfo info;
+  SDL_DisplayMode mode;
+
+  *vsync = 0;
+  if (win == NULL)
+    return 0;
+
+  if (SDL_GetRendererInfo(rend, &info) == 0)
+    *vsync = (info.flags & SDL_RENDERER_PRESENTVSYNC) != 0;
+
+  if (SDL_GetWindowDisplayMode(win, &mode) != 0)
+    return 0;
+
+  return mode.refresh_rate;
+}
+
 void toggle_fullscreen() {
 
+  if (win == NULL)
+    return;
+
   int fullscreen_state = SDL_GetWindowFlags(win) & SDL_WINDOW_FULLSCREEN;
 
   SDL_SetWindowFullscreen(win,
@@ -100,6 +323,9 @@ int draw_character(struct draw_character_command *command) {
 
   screenbuffer[virtual_y][virtual_x] = (char) command->c;
 
+  latency_draw_character(virtual_x, virtual_y, command->c, fgcolor, bgcolor);
+  shm_export_character(virtual_x, virtual_y, command->c, fgcolor, bgcolor);
+
   if(bgcolor == 0) {
     // We're drawing an unselected character
     selection_buffer[virtual_y][virtual_x] = (char) ' ';
@@ -113,7 +339,13 @@ int draw_character(struct draw_character_command *command) {
     }
   }
 
-  if (bgcolor == fgcolor) {
+  if (framebuffer != NULL) {
+    // Same placement as inprint, which draws one row below the command
+    raster_character(framebuffer, command->c, command->pos.x,
+                     command->pos.y + 3, 0xFF000000 | fgcolor,
+                     0xFF000000 | bgcolor, bgcolor != fgcolor);
+    mark_damaged(command->pos.y + 3, 8);
+  } else if (bgcolor == fgcolor) {
     // When bgcolor and fgcolor are the same, do not render a background
     inprint(rend, (char *)&command->c, command->pos.x, command->pos.y + 3,
             fgcolor, -1);
@@ -122,6 +354,7 @@ int draw_character(struct draw_character_command *command) {
             fgcolor, bgcolor);
   }
 
+  commands_drawn++;
   dirty = 1;
 
   return 1;
@@ -145,53 +378,127 @@ void draw_rectangle(struct draw_rectangle_command *command) {
     background_color.a = 0xFF;
   }
 
-  SDL_SetRenderDrawColor(rend, command->color.r, command->color.g,
-                         command->color.b, 0xFF);
-  SDL_RenderFillRect(rend, &render_rect);
+  if (framebuffer != NULL) {
+    raster_fill_rect(framebuffer, render_rect.x, render_rect.y, render_rect.w,
+                     render_rect.h,
+                     0xFF000000 | (command->color.r << 16) |
+                         (command->color.g << 8) | command->color.b);
+    mark_damaged(render_rect.y, render_rect.h);
+  } else {
+    SDL_SetRenderDrawColor(rend, command->color.r, command->color.g,
+                           command->color.b, 0xFF);
+    SDL_RenderFillRect(rend, &render_rect);
+  }
+
+  latency_draw_rectangle(render_rect.x, render_rect.y, render_rect.w,
+                         render_rect.h,
+                         (command->color.r << 16) | (command->color.g << 8) |
+                             command->color.b);
+  shm_export_rectangle(render_rect.x, render_rect.y, render_rect.w,
+                       render_rect.h,
+                       (command->color.r << 16) | (command->color.g << 8) |
+                           command->color.b);
 
+  commands_drawn++;
   dirty = 1;
 }
 
 void draw_waveform(struct draw_oscilloscope_waveform_command *command) {
 
-  static uint8_t wfm_cleared = 0;
+  commands_drawn++;
 
   // If the waveform is not being displayed and it's already been cleared, skip
   // rendering it
-  if (!(wfm_cleared && command->waveform_size == 0)) {
+  if (wfm_cleared && command->waveform_size == 0)
+    return;
+
+  // Only the newest packet is drawn when the screen is presented
+  waveforms_received++;
+  if (waveform_pending)
+    waveforms_merged++;
+
+  pending_waveform = *command;
+  waveform_pending = 1;
+
+  // The packet we just got was an empty waveform
+  wfm_cleared = command->waveform_size == 0;
+
+  dirty = 1;
+}
+
+// Draws the latest oscilloscope packet into the waveform strip. With the
+// framebuffer it is drawn in place, otherwise into its own texture that is
+// copied over the screen at present time.
+static void flush_waveform() {
+  if (!waveform_pending)
+    return;
+
+  waveform_pending = 0;
+
+  stats_begin();
 
+  struct draw_oscilloscope_waveform_command *command = &pending_waveform;
+  uint32_t background = 0xFF000000 | (background_color.r << 16) |
+                        (background_color.g << 8) | background_color.b;
+  uint32_t color = 0xFF000000 | (command->color.r << 16) |
+                   (command->color.g << 8) | command->color.b;
+
+  for (int i = 0; i < command->waveform_size; i++) {
+    // Limit value because the oscilloscope commands seem to glitch
+    // occasionally
+    if (command->waveform[i] > 20)
+      command->waveform[i] = 20;
+  }
+
+  if (framebuffer != NULL) {
+    raster_fill_rect(framebuffer, 0, 0, 320, 21, background);
+    raster_waveform(framebuffer, command->waveform, command->waveform_size,
+                    color);
+    mark_damaged(0, 21);
+  } else if (command->waveform_size == 0 || waveform_texture == NULL) {
+    // Waveform hidden, clear the strip on the screen once. Without the
+    // texture the waveform is drawn straight onto the screen.
     const SDL_Rect wf_rect = {0, 0, 320, 21};
 
     SDL_SetRenderDrawColor(rend, background_color.r, background_color.g,
                            background_color.b, background_color.a);
     SDL_RenderFillRect(rend, &wf_rect);
 
-    SDL_SetRenderDrawColor(rend, command->color.r, command->color.g,
-                           command->color.b, 255);
-
-    // Create a SDL_Point array of the waveform pixels for batch drawing
-    SDL_Point waveform_points[command->waveform_size];
-
-    for (int i = 0; i < command->waveform_size; i++) {
-      // Limit value because the oscilloscope commands seem to glitch
-      // occasionally
-      if (command->waveform[i] > 20)
-        command->waveform[i] = 20;
-      waveform_points[i].x = i;
-      waveform_points[i].y = command->waveform[i];
+    if (command->waveform_size > 0) {
+      SDL_Point waveform_points[command->waveform_size];
+
+      for (int i = 0; i < command->waveform_size; i++) {
+        waveform_points[i].x = i;
+        waveform_points[i].y = command->waveform[i];
+      }
+      SDL_SetRenderDrawColor(rend, command->color.r, command->color.g,
+                             command->color.b, 255);
+      SDL_RenderDrawPoints(rend, waveform_points, command->waveform_size);
     }
+    waveform_shown = 0;
+  } else {
+    raster_fill_rect(waveform_pixels, 0, 0, 320, 21, background);
+    raster_waveform(waveform_pixels, command->waveform, command->waveform_size,
+                    color);
+    SDL_UpdateTexture(waveform_texture, NULL, waveform_pixels,
+                      raster_width * sizeof(uint32_t));
+    waveform_shown = 1;
+  }
 
-    SDL_RenderDrawPoints(rend, waveform_points, command->waveform_size);
+  stats_end(stats_draw_waveform);
+}
 
-    // The packet we just drew was an empty waveform
-    if (command->waveform_size == 0) {
-      wfm_cleared = 1;
-    } else {
-      wfm_cleared = 0;
-    }
+static void composite_waveform() {
+  if (!waveform_shown || screensaver_active)
+    return;
 
-    dirty = 1;
-  }
+  const SDL_Rect wf_rect = {0, 0, 320, 21};
+  SDL_RenderCopy(rend, waveform_texture, NULL, &wf_rect);
+}
+
+void get_waveform_counts(uint32_t *received, uint32_t *merged) {
+  *received = waveforms_received;
+  *merged = waveforms_merged;
 }
 
 void display_keyjazz_overlay(uint8_t show, uint8_t base_octave,
@@ -244,6 +551,39 @@ int flow_initialized = 0;
 pthread_t current_flow_thread;
 int flow_running = 0;
 
+// The focused device's screen as last presented. The globals are swapped
+// between devices by render_select_device, so the flow thread reads this copy
+static pthread_mutex_t flow_screen_lock = PTHREAD_MUTEX_INITIALIZER;
+static char flow_screenbuffer[24][40];
+static char flow_selection_buffer[24][40];
+static int flow_selection_row = -1;
+
+static void publish_flow_screen() {
+  pthread_mutex_lock(&flow_screen_lock);
+  if (current_device == focused_device) {
+    memcpy(flow_screenbuffer, screenbuffer, sizeof(screenbuffer));
+    memcpy(flow_selection_buffer, selection_buffer, sizeof(selection_buffer));
+    flow_selection_row = new_selection_row;
+  } else {
+    const device_screen_s *screen = &device_screens[focused_device];
+    memcpy(flow_screenbuffer, screen->screenbuffer, sizeof(screenbuffer));
+    memcpy(flow_selection_buffer, screen->selection_buffer,
+           sizeof(selection_buffer));
+    flow_selection_row = screen->new_selection_row;
+  }
+  pthread_mutex_unlock(&flow_screen_lock);
+}
+
+// Copies the focused device's screen, called from the flow thread
+void render_copy_flow_screen(char screen[24][40], char selection[24][40],
+                             int *selection_row) {
+  pthread_mutex_lock(&flow_screen_lock);
+  memcpy(screen, flow_screenbuffer, sizeof(flow_screenbuffer));
+  memcpy(selection, flow_selection_buffer, sizeof(flow_selection_buffer));
+  *selection_row = flow_selection_row;
+  pthread_mutex_unlock(&flow_screen_lock);
+}
+
 void* flow_threadproc() {
   flow_running = 1;
 
@@ -270,17 +610,344 @@ void dispatch_flow() {
   pthread_create(&current_flow_thread, NULL, flow_threadproc, NULL);
 }
 
+// Prints a checksum of the headless frame and/or saves it to a BMP file
+static void output_headless_frame() {
+
+  headless_frames++;
+
+  if (headless_frame_hash) {
+    // 64bit FNV-1a over the visible pixels
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (int y = 0; y < headless_surface->h; y++) {
+      const uint8_t *row =
+          (const uint8_t *)headless_surface->pixels + y * headless_surface->pitch;
+      for (int x = 0; x < headless_surface->w * 4; x++) {
+        hash ^= row[x];
+        hash *= 0x100000001b3ULL;
+      }
+    }
+    printf("frame %u %016llx\n", headless_frames, (unsigned long long)hash);
+  }
+
+  if (headless_dump_dir != NULL) {
+    char filename[1024];
+    snprintf(filename, sizeof(filename), "%s/frame%06u.bmp", headless_dump_dir,
+             headless_frames);
+    if (SDL_SaveBMP(headless_surface, filename) != 0)
+      SDL_LogError(SDL_LOG_CATEGORY_VIDEO, "Cannot write %s: %s", filename,
+                   SDL_GetError());
+  }
+}
+
+// Publishes the finished frame to the shared memory export
+static void export_frame() {
+  static uint32_t pixels[raster_width * raster_height];
+
+  if (!shm_export_enabled() || screensaver_active)
+    return;
+
+  if (framebuffer != NULL) {
+    shm_export_frame(framebuffer, raster_width * sizeof(uint32_t));
+  } else if (headless_surface != NULL) {
+    shm_export_frame(headless_surface->pixels, headless_surface->pitch);
+  } else {
+    // Read back the screen texture, the waveform strip is composited over it
+    // only when presenting
+    if (SDL_RenderReadPixels(rend, NULL, SDL_PIXELFORMAT_ARGB8888, pixels,
+                             raster_width * sizeof(uint32_t)) != 0)
+      return;
+    if (waveform_shown)
+      memcpy(pixels, waveform_pixels, sizeof(waveform_pixels));
+    shm_export_frame(pixels, raster_width * sizeof(uint32_t));
+  }
+}
+
+// Copies the framebuffer to the window, upscaled by the largest integer
+// factor that fits and centered. The SDL software renderer does a plain blit
+// for an unscaled copy, instead of a per pixel scaled one.
+static void copy_framebuffer() {
+  int output_w, output_h;
+  SDL_GetRendererOutputSize(rend, &output_w, &output_h);
+
+  int scale = output_w / raster_width;
+  if (output_h / raster_height < scale)
+    scale = output_h / raster_height;
+
+  if (scale < 2) {
+    // Window too small to upscale, let SDL scale down the framebuffer
+    if (scaled_texture != NULL) {
+      SDL_DestroyTexture(scaled_texture);
+      scaled_texture = NULL;
+      scaled_factor = 0;
+    }
+    SDL_UpdateTexture(framebuffer_texture, NULL, framebuffer,
+                      raster_width * sizeof(uint32_t));
+    SDL_RenderCopy(rend, framebuffer_texture, NULL, NULL);
+    return;
+  }
+
+  if (scale != scaled_factor) {
+    if (scaled_texture != NULL)
+      SDL_DestroyTexture(scaled_texture);
+    scaled_texture = SDL_CreateTexture(
+        rend, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING,
+        raster_width * scale, raster_height * scale);
+    if (scaled_texture == NULL) {
+      SDL_LogError(SDL_LOG_CATEGORY_RENDER, "Cannot create %dx texture: %s",
+                   scale, SDL_GetError());
+      scaled_factor = 0;
+      return;
+    }
+    scaled_factor = scale;
+    damage_top = 0;
+    damage_bottom = raster_height;
+  }
+
+  if (damage_top < damage_bottom) {
+    SDL_Rect rect = {0, damage_top * scale, raster_width * scale,
+                     (damage_bottom - damage_top) * scale};
+    void *pixels;
+    int pitch;
+    if (SDL_LockTexture(scaled_texture, &rect, &pixels, &pitch) == 0) {
+      raster_scale_rows(framebuffer + damage_top * raster_width,
+                        damage_bottom - damage_top, scale, pixels,
+                        pitch / sizeof(uint32_t));
+      SDL_UnlockTexture(scaled_texture);
+    }
+    damage_top = raster_height;
+    damage_bottom = 0;
+  }
+
+  SDL_Rect dst = {(output_w - raster_width * scale) / 2,
+                  (output_h - raster_height * scale) / 2, raster_width * scale,
+                  raster_height * scale};
+
+  // Copy in window pixels, the overlays are drawn in logical coordinates
+  SDL_RenderSetLogicalSize(rend, 0, 0);
+  SDL_RenderCopy(rend, scaled_texture, NULL, &dst);
+  SDL_RenderSetLogicalSize(rend, logical_width, logical_height);
+}
+
+static void save_device_screen(device_screen_s *screen) {
+  screen->maintexture = maintexture;
+  screen->framebuffer = framebuffer;
+  screen->framebuffer_texture = framebuffer_texture;
+  screen->waveform_texture = waveform_texture;
+  screen->background_color = background_color;
+  memcpy(screen->screenbuffer, screenbuffer, sizeof(screenbuffer));
+  memcpy(screen->selection_buffer, selection_buffer, sizeof(selection_buffer));
+  screen->new_selection_row = new_selection_row;
+  screen->pending_waveform = pending_waveform;
+  screen->waveform_pending = waveform_pending;
+  screen->waveform_shown = waveform_shown;
+  screen->wfm_cleared = wfm_cleared;
+  screen->damage_top = damage_top;
+  screen->damage_bottom = damage_bottom;
+}
+
+static void load_device_screen(const device_screen_s *screen) {
+  maintexture = screen->maintexture;
+  framebuffer = screen->framebuffer;
+  framebuffer_texture = screen->framebuffer_texture;
+  waveform_texture = screen->waveform_texture;
+  background_color = screen->background_color;
+  memcpy(screenbuffer, screen->screenbuffer, sizeof(screenbuffer));
+  memcpy(selection_buffer, screen->selection_buffer, sizeof(selection_buffer));
+  new_selection_row = screen->new_selection_row;
+  pending_waveform = screen->pending_waveform;
+  waveform_pending = screen->waveform_pending;
+  waveform_shown = screen->waveform_shown;
+  wfm_cleared = screen->wfm_cleared;
+  damage_top = screen->damage_top;
+  damage_bottom = screen->damage_bottom;
+}
+
+// Creates the screens for devices 1..count-1, device 0 uses the screen
+// created by initialize_sdl. The window is laid out as a grid of tiles.
+int render_set_device_count(int count) {
+  if (count < 1 || count > max_screens || headless_surface != NULL) {
+    SDL_LogError(SDL_LOG_CATEGORY_RENDER, "Cannot show %d devices", count);
+    return -1;
+  }
+
+  for (int i = 1; i < count; i++) {
+    device_screen_s *screen = &device_screens[i];
+    memset(screen, 0, sizeof(*screen));
+    screen->new_selection_row = -1;
+    screen->damage_bottom = raster_height;
+    // Counted right away so close_renderer() frees a partly created screen
+    device_count = i + 1;
+
+    screen->maintexture = SDL_CreateTexture(rend, SDL_PIXELFORMAT_ARGB8888,
+                                            SDL_TEXTUREACCESS_TARGET, 320, 240);
+    if (screen->maintexture == NULL)
+      goto error;
+    SDL_SetRenderTarget(rend, screen->maintexture);
+    SDL_SetRenderDrawColor(rend, 0x00, 0x00, 0x00, 0x00);
+    SDL_RenderClear(rend);
+
+    if (framebuffer != NULL) {
+      screen->framebuffer =
+          calloc(raster_width * raster_height, sizeof(uint32_t));
+      screen->framebuffer_texture =
+          SDL_CreateTexture(rend, SDL_PIXELFORMAT_ARGB8888,
+                            SDL_TEXTUREACCESS_STREAMING, 320, 240);
+      if (screen->framebuffer == NULL || screen->framebuffer_texture == NULL)
+        goto error;
+    } else {
+      screen->waveform_texture =
+          SDL_CreateTexture(rend, SDL_PIXELFORMAT_ARGB8888,
+                            SDL_TEXTUREACCESS_STREAMING, 320, 21);
+      if (screen->waveform_texture == NULL)
+        goto error;
+    }
+  }
+
+  tile_columns = 1;
+  while (tile_columns * tile_columns < count)
+    tile_columns++;
+  int tile_rows = (count + tile_columns - 1) / tile_columns;
+  logical_width = 320 * tile_columns;
+  logical_height = 240 * tile_rows;
+
+  // A logical size set while a texture is the target only lasts until the
+  // target changes, so it is set on the window itself
+  SDL_SetRenderTarget(rend, NULL);
+  SDL_RenderSetLogicalSize(rend, logical_width, logical_height);
+  SDL_SetRenderTarget(rend, maintexture);
+  if (win != NULL) {
+    int window_scale = tile_columns > 2 ? 1 : 2;
+    SDL_SetWindowSize(win, 320 * tile_columns * window_scale,
+                      240 * tile_rows * window_scale);
+  }
+
+  dirty = 1;
+  return 1;
+
+error:
+  SDL_LogError(SDL_LOG_CATEGORY_RENDER, "Cannot create device screens: %s",
+               SDL_GetError());
+  SDL_SetRenderTarget(rend, maintexture);
+  return -1;
+}
+
+// Directs the drawing commands to the screen of a device
+void render_select_device(int index) {
+  if (index == current_device || index < 0 || index >= device_count)
+    return;
+
+  // The merged waveform belongs to the device being left
+  flush_waveform();
+
+  save_device_screen(&device_screens[current_device]);
+  load_device_screen(&device_screens[index]);
+  current_device = index;
+
+  SDL_SetRenderTarget(rend, maintexture);
+}
+
+// The focused device gets the input and is outlined in the window
+void render_set_focus(int index) {
+  if (index < 0 || index >= device_count)
+    return;
+
+  focused_device = index;
+  dirty = 1;
+}
+
+// Returns the device shown at the given logical coordinates, or -1
+int render_device_at(int x, int y) {
+  if (device_count < 2 || x < 0 || y < 0)
+    return -1;
+
+  int index = (y / 240) * tile_columns + x / 320;
+  return x / 320 < tile_columns && index < device_count ? index : -1;
+}
+
+static void render_tiles() {
+  save_device_screen(&device_screens[current_device]);
+
+  for (int i = 0; i < device_count; i++) {
+    device_screen_s *screen = &device_screens[i];
+    SDL_Rect tile = {(i % tile_columns) * 320, (i / tile_columns) * 240, 320,
+                     240};
+
+    if (screen->framebuffer != NULL) {
+      if (screen->damage_top < screen->damage_bottom) {
+        SDL_UpdateTexture(screen->framebuffer_texture, NULL,
+                          screen->framebuffer, raster_width * sizeof(uint32_t));
+        screen->damage_top = raster_height;
+        screen->damage_bottom = 0;
+      }
+      SDL_RenderCopy(rend, screen->framebuffer_texture, NULL, &tile);
+    } else {
+      SDL_RenderCopy(rend, screen->maintexture, NULL, &tile);
+      if (screen->waveform_shown) {
+        const SDL_Rect wf_rect = {tile.x, tile.y, 320, 21};
+        SDL_RenderCopy(rend, screen->waveform_texture, NULL, &wf_rect);
+      }
+    }
+
+    if (i == focused_device) {
+      SDL_SetRenderDrawColor(rend, 0x80, 0x80, 0x80, 0xFF);
+      SDL_RenderDrawRect(rend, &tile);
+    }
+  }
+
+  // The uploads above reset the damage of the selected device too
+  damage_top = device_screens[current_device].damage_top;
+  damage_bottom = device_screens[current_device].damage_bottom;
+}
+
 void render_screen() {
+  // Redraw when the stats overlay has new values
+  if (stats_update())
+    dirty = 1;
+
   if (dirty) {
     dirty = 0;
-    
-    SDL_SetRenderTarget(rend, NULL);
-    SDL_SetRenderDrawColor(rend, 0, 0, 0, 0);
-    SDL_RenderClear(rend);
-    SDL_RenderCopy(rend, maintexture, NULL, NULL);
-    SDL_RenderPresent(rend);
-    SDL_SetRenderTarget(rend, maintexture);
 
+    if (headless_surface != NULL) {
+      flush_waveform();
+      composite_waveform();
+
+      // Flushes the queued drawing into the surface
+      stats_begin();
+      SDL_RenderPresent(rend);
+      stats_end(stats_present);
+      latency_presented();
+      output_headless_frame();
+      export_frame();
+    } else {
+      flush_waveform();
+
+      stats_begin();
+      SDL_SetRenderTarget(rend, NULL);
+      SDL_SetRenderDrawColor(rend, 0, 0, 0, 0);
+      SDL_RenderClear(rend);
+      if (device_count > 1) {
+        render_tiles();
+      } else if (framebuffer != NULL && !screensaver_active) {
+        copy_framebuffer();
+        composite_waveform();
+      } else {
+        SDL_RenderCopy(rend, maintexture, NULL, NULL);
+        composite_waveform();
+      }
+      stats_draw_overlay(rend);
+      stats_end(stats_render);
+
+      stats_begin();
+      pacing_present_begin();
+      SDL_RenderPresent(rend);
+      pacing_presented();
+      stats_end(stats_present);
+      latency_presented();
+      SDL_SetRenderTarget(rend, maintexture);
+      export_frame();
+    }
+
+    publish_flow_screen();
     dispatch_flow();
 
     fps++;
@@ -295,6 +962,8 @@ void render_screen() {
 
 void screensaver_init() {
   fx_cube_init(rend, (SDL_Color){255, 255, 255, 255});
+  // The cube is drawn with the SDL renderer into maintexture
+  screensaver_active = 1;
   SDL_LogDebug(SDL_LOG_CATEGORY_APPLICATION, "Screensaver initialized");
 }
 
@@ -305,5 +974,6 @@ void screensaver_draw() {
 
 void screensaver_destroy() {
   fx_cube_destroy();
+  screensaver_active = 0;
   SDL_LogDebug(SDL_LOG_CATEGORY_APPLICATION, "Screensaver destroyed");
 }
\ No newline at end of file
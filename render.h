@@ -7,6 +7,7 @@
 #include "command.h"
 
 int initialize_sdl(int init_fullscreen, int init_use_gpu);
+int initialize_headless(int frame_hash, const char *dump_dir);
 void close_renderer();
 
 int process_queues(struct command_queues *queues);
@@ -14,8 +15,21 @@ void draw_waveform(struct draw_oscilloscope_waveform_command *command);
 void draw_rectangle(struct draw_rectangle_command *command);
 int draw_character(struct draw_character_command *command);
 
+// Oscilloscope packets received, and how many of them were replaced by a
+// newer packet before they were drawn
+void get_waveform_counts(uint32_t *received, uint32_t *merged);
+
 void render_screen();
+
+// Showing several devices at once
+int render_set_device_count(int count);
+void render_select_device(int index);
+void render_set_focus(int index);
+int render_device_at(int x, int y);
+void render_copy_flow_screen(char screen[24][40], char selection[24][40],
+                             int *selection_row);
 void toggle_fullscreen();
+int get_display_refresh(int *vsync);
 void display_keyjazz_overlay(uint8_t show, uint8_t base_octave, uint8_t velocity);
 
 void screensaver_init();
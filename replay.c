@@ -0,0 +1,196 @@
+// Records the raw bytes read from the M8 serial port into a file and replays
+// them without a device attached, so that decoding and rendering can be
+// benchmarked reproducibly.
+//
+// File format (all values little-endian):
+//   header: "M8CR" magic, 32bit format version
+//   chunk:  32bit timestamp in ms from the start of the recording,
+//           16bit data length, data bytes
+
+#include "replay.h"
+
+#include <SDL.h>
+
+#define replay_header_size 8
+#define replay_chunk_header_size 6
+#define replay_version 1
+
+static const char replay_magic[4] = {'M', '8', 'C', 'R'};
+
+static SDL_RWops *record_rw = NULL;
+static uint32_t record_start_ticks;
+
+static uint8_t *replay_data = NULL;
+static size_t replay_data_size;
+static size_t replay_position;
+static uint32_t replay_chunk_remaining = 0;
+
+static float replay_speed;
+static uint32_t replay_clock; // current replay position in recorded ms
+static uint32_t replay_start_ticks;
+static uint32_t replay_bytes;
+static uint32_t replay_chunks;
+
+static void encode_uint32(uint8_t *data, uint32_t value) {
+  data[0] = value & 0xFF;
+  data[1] = (value >> 8) & 0xFF;
+  data[2] = (value >> 16) & 0xFF;
+  data[3] = (value >> 24) & 0xFF;
+}
+
+static uint32_t decode_uint32(const uint8_t *data) {
+  return data[0] | (uint32_t)data[1] << 8 | (uint32_t)data[2] << 16 |
+         (uint32_t)data[3] << 24;
+}
+
+int record_open(const char *filename) {
+  uint8_t header[replay_header_size];
+
+  record_rw = SDL_RWFromFile(filename, "wb");
+  if (record_rw == NULL) {
+    SDL_LogError(SDL_LOG_CATEGORY_SYSTEM, "Cannot open %s for recording: %s",
+                 filename, SDL_GetError());
+    return -1;
+  }
+
+  SDL_memcpy(header, replay_magic, sizeof(replay_magic));
+  encode_uint32(&header[4], replay_version);
+  SDL_RWwrite(record_rw, header, 1, sizeof(header));
+
+  record_start_ticks = SDL_GetTicks();
+  SDL_Log("Recording serial data to %s", filename);
+  return 1;
+}
+
+void record_write(const uint8_t *data, int size) {
+  uint8_t header[replay_chunk_header_size];
+
+  if (record_rw == NULL || size <= 0)
+    return;
+
+  encode_uint32(header, SDL_GetTicks() - record_start_ticks);
+  header[4] = size & 0xFF;
+  header[5] = (size >> 8) & 0xFF;
+
+  if (SDL_RWwrite(record_rw, header, 1, sizeof(header)) != sizeof(header) ||
+      SDL_RWwrite(record_rw, data, 1, size) != (size_t)size) {
+    SDL_LogError(SDL_LOG_CATEGORY_SYSTEM,
+                 "Error writing recording, stopping: %s", SDL_GetError());
+    record_close();
+  }
+}
+
+void record_close() {
+  if (record_rw != NULL) {
+    SDL_RWclose(record_rw);
+    record_rw = NULL;
+  }
+}
+
+int replay_open(const char *filename, float speed) {
+  SDL_RWops *rw = SDL_RWFromFile(filename, "rb");
+  if (rw == NULL) {
+    SDL_LogError(SDL_LOG_CATEGORY_SYSTEM, "Cannot open replay file %s: %s",
+                 filename, SDL_GetError());
+    return -1;
+  }
+
+  // Read the whole file into memory to keep file I/O out of the measurements
+  Sint64 size = SDL_RWsize(rw);
+  if (size < replay_header_size) {
+    SDL_LogError(SDL_LOG_CATEGORY_SYSTEM, "Replay file %s is too short",
+                 filename);
+    SDL_RWclose(rw);
+    return -1;
+  }
+
+  replay_data = malloc(size);
+  replay_data_size = SDL_RWread(rw, replay_data, 1, size);
+  SDL_RWclose(rw);
+
+  if (replay_data_size != (size_t)size ||
+      SDL_memcmp(replay_data, replay_magic, sizeof(replay_magic)) != 0 ||
+      decode_uint32(&replay_data[4]) != replay_version) {
+    SDL_LogError(SDL_LOG_CATEGORY_SYSTEM, "%s is not a m8c recording",
+                 filename);
+    free(replay_data);
+    replay_data = NULL;
+    return -1;
+  }
+
+  replay_position = replay_header_size;
+  replay_chunk_remaining = 0;
+  replay_speed = speed;
+  replay_clock = 0;
+  replay_bytes = 0;
+  replay_chunks = 0;
+  replay_start_ticks = SDL_GetTicks();
+
+  if (speed > 0)
+    SDL_Log("Replaying %s at %.2fx speed", filename, speed);
+  else
+    SDL_Log("Replaying %s as fast as possible", filename);
+  return 1;
+}
+
+// Moves the replay clock forward. In real-time mode the clock follows the
+// wall clock, otherwise it advances by one main loop interval per call.
+void replay_advance(uint32_t interval_ms) {
+  if (replay_speed > 0)
+    replay_clock = (SDL_GetTicks() - replay_start_ticks) * replay_speed;
+  else
+    replay_clock += interval_ms;
+}
+
+// Copies the data of the next chunk that is due at the current replay clock
+// into buf. Returns the number of bytes copied or 0 if nothing is due yet.
+int replay_read(uint8_t *buf, int size) {
+  if (replay_data == NULL)
+    return 0;
+
+  if (replay_chunk_remaining == 0) {
+    if (replay_position + replay_chunk_header_size > replay_data_size)
+      return 0;
+
+    const uint8_t *header = &replay_data[replay_position];
+    if (decode_uint32(header) > replay_clock)
+      return 0;
+
+    replay_chunk_remaining = header[4] | (uint32_t)header[5] << 8;
+    replay_position += replay_chunk_header_size;
+    replay_chunks++;
+
+    // Truncated recording, replay what is there
+    if (replay_position + replay_chunk_remaining > replay_data_size)
+      replay_chunk_remaining = replay_data_size - replay_position;
+  }
+
+  int bytes = replay_chunk_remaining < (uint32_t)size ? replay_chunk_remaining
+                                                      : (uint32_t)size;
+  SDL_memcpy(buf, &replay_data[replay_position], bytes);
+  replay_position += bytes;
+  replay_chunk_remaining -= bytes;
+  replay_bytes += bytes;
+
+  return bytes;
+}
+
+int replay_finished() {
+  return replay_data == NULL ||
+         (replay_chunk_remaining == 0 &&
+          replay_position + replay_chunk_header_size > replay_data_size);
+}
+
+void replay_close() {
+  if (replay_data == NULL)
+    return;
+
+  uint32_t elapsed = SDL_GetTicks() - replay_start_ticks;
+  SDL_Log("Replayed %u bytes in %u chunks, %u ms of recording in %u ms "
+          "(%.1f kB/s)",
+          replay_bytes, replay_chunks, replay_clock, elapsed,
+          elapsed ? replay_bytes / (float)elapsed : 0);
+
+  free(replay_data);
+  replay_data = NULL;
+}
@@ -0,0 +1,19 @@
+#ifndef REPLAY_H_
+#define REPLAY_H_
+
+#include <stdint.h>
+
+// Recording of the raw serial stream
+int record_open(const char *filename);
+void record_write(const uint8_t *data, int size);
+void record_close();
+
+// Replaying a recorded serial stream. A speed of 0 replays as fast as
+// possible, otherwise the recorded timing is scaled by the speed factor.
+int replay_open(const char *filename, float speed);
+void replay_advance(uint32_t interval_ms);
+int replay_read(uint8_t *buf, int size);
+int replay_finished();
+void replay_close();
+
+#endif
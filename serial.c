@@ -15,6 +15,11 @@
 // Helper function for error handling
 static int check(enum sp_return result);
 
+// Serial port given on the command line, used instead of USB detection
+static const char *port_name = NULL;
+
+void set_serial_port_name(const char *name) { port_name = name; }
+
 static int detect_m8_serial_device(struct sp_port *port) {
   // Check the connection method - we want USB serial devices
   enum sp_transport transport = sp_get_port_transport(port);
@@ -36,6 +41,15 @@ int check_serial_port(struct sp_port *m8_port) {
 
   int device_found = 0;
 
+  // Explicitly named ports (e.g. a pty) are not listed, look them up by name
+  if (port_name != NULL) {
+    struct sp_port *port;
+    if (sp_get_port_by_name(port_name, &port) != SP_OK)
+      return 0;
+    sp_free_port(port);
+    return 1;
+  }
+
   /* A pointer to a null-terminated array of pointers to
    * struct sp_port, which will contain the ports found.*/
   struct sp_port **port_list;
@@ -65,64 +79,118 @@ int check_serial_port(struct sp_port *m8_port) {
 
 }
 
-struct sp_port *init_serial(int verbose) {
-  /* A pointer to a null-terminated array of pointers to
-   * struct sp_port, which will contain the ports found.*/
-  struct sp_port *m8_port = NULL;
-  struct sp_port **port_list;
+// Opens the serial port and configures it
+static enum sp_return open_port(struct sp_port *m8_port) {
+  SDL_Log("Opening port.\n");
+  enum sp_return result;
 
-  if (verbose)
-    SDL_Log("Looking for USB serial devices.\n");
+  result = sp_open(m8_port, SP_MODE_READ_WRITE);
+  if (check(result) != SP_OK)
+    return result;
 
-  /* Call sp_list_ports() to get the ports. The port_list
-   * pointer will be updated to refer to the array created. */
-  enum sp_return result = sp_list_ports(&port_list);
+  result = sp_set_baudrate(m8_port, 115200);
+  if (check(result) != SP_OK)
+    return result;
 
-  if (result != SP_OK) {
+  result = sp_set_bits(m8_port, 8);
+  if (check(result) != SP_OK)
+    return result;
+
+  result = sp_set_parity(m8_port, SP_PARITY_NONE);
+  if (check(result) != SP_OK)
+    return result;
+
+  result = sp_set_stopbits(m8_port, 1);
+  if (check(result) != SP_OK)
+    return result;
+
+  result = sp_set_flowcontrol(m8_port, SP_FLOWCONTROL_NONE);
+  return check(result);
+}
+
+// Lists the names of all connected M8s. Returns the number of names.
+int list_m8_ports(char names[][serial_port_name_length], int max) {
+  struct sp_port **port_list;
+  int count = 0;
+
+  if (sp_list_ports(&port_list) != SP_OK) {
     SDL_LogError(SDL_LOG_CATEGORY_SYSTEM, "sp_list_ports() failed!\n");
-    abort();
+    return 0;
   }
 
-  /* Iterate through the ports. When port_list[i] is NULL
-   * this indicates the end of the list. */
-  for (int i = 0; port_list[i] != NULL; i++) {
-    struct sp_port *port = port_list[i];
-
-    if (detect_m8_serial_device(port)) {
-      SDL_Log("Found M8 in %s.\n", sp_get_port_name(port));
-      sp_copy_port(port, &m8_port);
+  for (int i = 0; port_list[i] != NULL && count < max; i++) {
+    if (detect_m8_serial_device(port_list[i])) {
+      snprintf(names[count++], serial_port_name_length, "%s",
+               sp_get_port_name(port_list[i]));
     }
   }
 
   sp_free_port_list(port_list);
+  return count;
+}
 
-  if (m8_port != NULL) {
-    // Open the serial port and configure it
-    SDL_Log("Opening port.\n");
-    enum sp_return result;
+// Opens the named port, for running several devices at once
+struct sp_port *open_serial_port(const char *name) {
+  struct sp_port *m8_port;
 
-    result = sp_open(m8_port, SP_MODE_READ_WRITE);
-    if (check(result) != SP_OK)
-      return NULL;
+  if (sp_get_port_by_name(name, &m8_port) != SP_OK) {
+    SDL_LogCritical(SDL_LOG_CATEGORY_SYSTEM, "Cannot open %s.\n", name);
+    return NULL;
+  }
 
-    result = sp_set_baudrate(m8_port, 115200);
-    if (check(result) != SP_OK)
-      return NULL;
+  SDL_Log("Using M8 in %s.\n", name);
 
-    result = sp_set_bits(m8_port, 8);
-    if (check(result) != SP_OK)
-      return NULL;
+  if (open_port(m8_port) != SP_OK) {
+    sp_free_port(m8_port);
+    return NULL;
+  }
 
-    result = sp_set_parity(m8_port, SP_PARITY_NONE);
-    if (check(result) != SP_OK)
-      return NULL;
+  return m8_port;
+}
 
-    result = sp_set_stopbits(m8_port, 1);
-    if (check(result) != SP_OK)
+struct sp_port *init_serial(int verbose) {
+  /* A pointer to a null-terminated array of pointers to
+   * struct sp_port, which will contain the ports found.*/
+  struct sp_port *m8_port = NULL;
+  struct sp_port **port_list;
+
+  if (port_name != NULL) {
+    if (sp_get_port_by_name(port_name, &m8_port) != SP_OK) {
+      if (verbose)
+        SDL_LogCritical(SDL_LOG_CATEGORY_SYSTEM, "Cannot open %s.\n",
+                        port_name);
       return NULL;
+    }
+    SDL_Log("Using M8 in %s.\n", port_name);
+  } else {
+    if (verbose)
+      SDL_Log("Looking for USB serial devices.\n");
+
+    /* Call sp_list_ports() to get the ports. The port_list
+     * pointer will be updated to refer to the array created. */
+    enum sp_return result = sp_list_ports(&port_list);
+
+    if (result != SP_OK) {
+      SDL_LogError(SDL_LOG_CATEGORY_SYSTEM, "sp_list_ports() failed!\n");
+      abort();
+    }
 
-    result = sp_set_flowcontrol(m8_port, SP_FLOWCONTROL_NONE);
-    if (check(result) != SP_OK)
+    /* Iterate through the ports. When port_list[i] is NULL
+     * this indicates the end of the list. */
+    for (int i = 0; port_list[i] != NULL; i++) {
+      struct sp_port *port = port_list[i];
+
+      if (detect_m8_serial_device(port)) {
+        SDL_Log("Found M8 in %s.\n", sp_get_port_name(port));
+        sp_copy_port(port, &m8_port);
+      }
+    }
+
+    sp_free_port_list(port_list);
+  }
+
+  if (m8_port != NULL) {
+    if (open_port(m8_port) != SP_OK)
       return NULL;
   } else {
     if (verbose)
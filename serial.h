@@ -6,6 +6,11 @@
 
 #include <libserialport.h>
 
+#define serial_port_name_length 256
+
+void set_serial_port_name(const char *name);
+int list_m8_ports(char names[][serial_port_name_length], int max);
+struct sp_port *open_serial_port(const char *name);
 struct sp_port *init_serial(int verbose);
 int check_serial_port(struct sp_port *m8_port);
 
@@ -0,0 +1,151 @@
+// Publishes the decoded M8 screen in POSIX shared memory, so that loggers,
+// braille bridges and stream overlays can read it without a serial client
+// of their own. See shm_export.h for the layout and the reading protocol.
+
+#include "shm_export.h"
+
+#include <SDL.h>
+#include <string.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#define shm_supported 1
+#endif
+
+#ifdef __linux__
+#include <limits.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+static m8_shm_s *shm = NULL;
+static const char *shm_name;
+
+// The cells change between frames, they are copied to the region together
+// with the frame so readers always see a matching pair
+static m8_shm_cell_s cells[m8_shm_rows][m8_shm_columns];
+
+int shm_export_open(const char *name) {
+#ifdef shm_supported
+  int fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+  if (fd == -1) {
+    SDL_LogError(SDL_LOG_CATEGORY_SYSTEM, "Cannot open shared memory %s",
+                 name);
+    return -1;
+  }
+
+  if (ftruncate(fd, sizeof(m8_shm_s)) == -1) {
+    SDL_LogError(SDL_LOG_CATEGORY_SYSTEM, "Cannot resize shared memory %s",
+                 name);
+    close(fd);
+    shm_unlink(name);
+    return -1;
+  }
+
+  void *region = mmap(NULL, sizeof(m8_shm_s), PROT_READ | PROT_WRITE,
+                      MAP_SHARED, fd, 0);
+  close(fd);
+  if (region == MAP_FAILED) {
+    SDL_LogError(SDL_LOG_CATEGORY_SYSTEM, "Cannot map shared memory %s",
+                 name);
+    shm_unlink(name);
+    return -1;
+  }
+
+  shm = region;
+  shm_name = name;
+  memset(shm, 0, sizeof(m8_shm_s));
+  memset(cells, 0, sizeof(cells));
+
+  shm->version = m8_shm_version;
+  shm->columns = m8_shm_columns;
+  shm->rows = m8_shm_rows;
+  shm->width = m8_shm_width;
+  shm->height = m8_shm_height;
+  __atomic_store_n(&shm->magic, m8_shm_magic, __ATOMIC_RELEASE);
+
+  SDL_Log("Exporting the screen to shared memory %s", name);
+  return 1;
+#else
+  SDL_LogError(SDL_LOG_CATEGORY_SYSTEM,
+               "Shared memory export is not supported on this system");
+  return -1;
+#endif
+}
+
+int shm_export_enabled() { return shm != NULL; }
+
+void shm_export_close() {
+#ifdef shm_supported
+  if (shm == NULL)
+    return;
+
+  munmap(shm, sizeof(m8_shm_s));
+  shm_unlink(shm_name);
+  shm = NULL;
+#endif
+}
+
+void shm_export_character(int column, int row, int c, uint32_t foreground,
+                          uint32_t background) {
+  if (shm == NULL || column < 0 || column >= m8_shm_columns || row < 0 ||
+      row >= m8_shm_rows)
+    return;
+
+  m8_shm_cell_s *cell = &cells[row][column];
+  cell->c = c;
+  cell->foreground = foreground;
+  cell->background = background;
+  cell->selected = background != 0;
+}
+
+// A rectangle covering a cell whole erases its character
+void shm_export_rectangle(int x, int y, int w, int h, uint32_t color) {
+  if (shm == NULL)
+    return;
+
+  // Cells are laid out like in draw_character
+  int first_column = x <= 8 ? 0 : (x - 8 + 7) / 8;
+  int last_column = (x + w - 8) / 8 - 1;
+  int first_row = y <= 10 ? 0 : (y - 10 + 9) / 10;
+  int last_row = (y + h - 10) / 10 - 1;
+
+  if (last_column >= m8_shm_columns)
+    last_column = m8_shm_columns - 1;
+  if (last_row >= m8_shm_rows)
+    last_row = m8_shm_rows - 1;
+
+  for (int row = first_row; row <= last_row; row++) {
+    for (int column = first_column; column <= last_column; column++) {
+      m8_shm_cell_s *cell = &cells[row][column];
+      cell->c = ' ';
+      cell->background = color;
+      cell->selected = 0;
+    }
+  }
+}
+
+// Copies the finished frame and the cells into the region and wakes up the
+// readers waiting for it
+void shm_export_frame(const void *pixels, int pitch) {
+  if (shm == NULL)
+    return;
+
+  uint32_t sequence = shm->sequence + 1;
+  __atomic_store_n(&shm->sequence, sequence, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  memcpy(shm->cells, cells, sizeof(cells));
+  for (int y = 0; y < m8_shm_height; y++)
+    memcpy(shm->framebuffer[y], (const uint8_t *)pixels + y * pitch,
+           sizeof(shm->framebuffer[y]));
+  shm->frame++;
+
+  __atomic_store_n(&shm->sequence, sequence + 1, __ATOMIC_RELEASE);
+
+#ifdef __linux__
+  syscall(SYS_futex, &shm->sequence, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+#endif
+}
@@ -0,0 +1,53 @@
+#ifndef SHM_EXPORT_H_
+#define SHM_EXPORT_H_
+
+#include <stdint.h>
+
+// Layout of the shared memory region. Other programs can include this file
+// and map the region read only.
+//
+// The region is updated once per presented frame. sequence is odd while an
+// update is being written and even when the data is consistent: read it,
+// copy what is needed, and check that it has not changed. On Linux the
+// writer wakes up futex waiters on sequence after each update, so a reader
+// can sleep with FUTEX_WAIT on the last value it has seen.
+
+#define m8_shm_magic 0x4D38534D // "M8SM"
+#define m8_shm_version 1
+#define m8_shm_columns 40
+#define m8_shm_rows 24
+#define m8_shm_width 320
+#define m8_shm_height 240
+
+typedef struct m8_shm_cell_s {
+  uint32_t foreground; // 0x00RRGGBB
+  uint32_t background;
+  uint8_t c;
+  uint8_t selected;
+  uint8_t padding[2];
+} m8_shm_cell_s;
+
+typedef struct m8_shm_s {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t sequence;
+  uint32_t frame;
+  uint32_t columns;
+  uint32_t rows;
+  uint32_t width;
+  uint32_t height;
+  m8_shm_cell_s cells[m8_shm_rows][m8_shm_columns];
+  uint32_t framebuffer[m8_shm_height][m8_shm_width]; // ARGB8888
+} m8_shm_s;
+
+int shm_export_open(const char *name);
+int shm_export_enabled();
+void shm_export_close();
+
+// Hooks called by the renderer
+void shm_export_character(int column, int row, int c, uint32_t foreground,
+                          uint32_t background);
+void shm_export_rectangle(int x, int y, int w, int h, uint32_t color);
+void shm_export_frame(const void *pixels, int pitch);
+
+#endif
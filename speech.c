@@ -0,0 +1,262 @@
+// Synthesized speech for the flow mode, with a cache of the synthesized
+// waveforms. While nothing is being said, the announcements that are likely
+// to be needed next are synthesized in the background, so that they can be
+// played without waiting for the synthesizer.
+//
+// Every synthesis has its own flite context, so the announcement being said
+// never waits for the background synthesis, which runs at idle priority.
+
+#include "speech.h"
+#include "synth_pool.h"
+
+#include <SDL.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define cache_size 32
+
+typedef struct cache_entry_s {
+  char *text;
+  cst_wave *wave;
+  int refs;          // waves being played can not be evicted
+  uint32_t last_used;
+} cache_entry_s;
+
+static cst_voice *speech_voice = NULL;
+
+// Quality levels for the announcements, lowered when the synthesis is slow
+// compared to the length of what it says. Each level drops more high order
+// mceps in the vocoder, the last also skips MLPG for short utterances.
+static const int speed_params[] = {0, 5, 10, 15, 20};
+#define quality_levels 5
+#define mlpg_skip_frames 400 // 2 seconds
+#define rtf_too_slow 0.5f    // lower the quality above this real-time factor
+#define rtf_headroom 0.2f    // raise it after several announcements below
+#define headroom_count 3
+
+// A cancelled thread can still be finishing its playback, and play_wave()
+// keeps its position in the wave
+static pthread_mutex_t play_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// cache_lock protects everything below
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static cache_entry_s cache[cache_size];
+static uint32_t cache_clock = 0;
+static uint32_t hits = 0;
+static uint32_t misses = 0;
+static uint32_t speculated = 0;
+static int quality_level = 0;
+static int fast_syntheses = 0;
+static float last_rtf = 0;
+
+static cache_entry_s *cache_find(const char *text) {
+  for (int i = 0; i < cache_size; i++) {
+    if (cache[i].text != NULL && strcmp(cache[i].text, text) == 0)
+      return &cache[i];
+  }
+  return NULL;
+}
+
+// Stores a wave, evicting the least recently used one. Returns the entry or
+// NULL if every entry is being played. Called with cache_lock held.
+static cache_entry_s *cache_put(const char *text, cst_wave *wave) {
+  cache_entry_s *victim = NULL;
+
+  for (int i = 0; i < cache_size; i++) {
+    if (cache[i].refs == 0 &&
+        (victim == NULL || cache[i].text == NULL ||
+         (victim->text != NULL && cache[i].last_used < victim->last_used)))
+      victim = &cache[i];
+  }
+
+  if (victim == NULL)
+    return NULL;
+
+  if (victim->text != NULL) {
+    free(victim->text);
+    delete_wave(victim->wave);
+  }
+
+  victim->text = strdup(text);
+  if (victim->text == NULL)
+    return NULL;
+  victim->wave = wave;
+  victim->refs = 0;
+  victim->last_used = ++cache_clock;
+  return victim;
+}
+
+// Adjusts the quality level for the real-time factor of a synthesis, the
+// time it took over the duration of the audio. Called with cache_lock held,
+// so it returns the change for the caller to print once unlocked: printf is
+// a cancellation point and play_cleanup takes cache_lock.
+static int update_quality(float rtf) {
+  last_rtf = rtf;
+
+  if (rtf > rtf_too_slow) {
+    fast_syntheses = 0;
+    if (quality_level < quality_levels - 1) {
+      quality_level++;
+      return 1;
+    }
+  } else if (rtf < rtf_headroom && quality_level > 0 &&
+             ++fast_syntheses >= headroom_count) {
+    fast_syntheses = 0;
+    quality_level--;
+    return -1;
+  }
+  return 0;
+}
+
+void speech_get_quality(int *level, int *speed_param, float *rtf) {
+  pthread_mutex_lock(&cache_lock);
+  *level = quality_level;
+  *speed_param = speed_params[quality_level];
+  *rtf = last_rtf;
+  pthread_mutex_unlock(&cache_lock);
+}
+
+// Stores a wave synthesized in the background
+static void speculation_done(const char *text, cst_wave *wave, void *data) {
+  if (wave == NULL)
+    return;
+
+  pthread_mutex_lock(&cache_lock);
+  if (cache_find(text) == NULL && cache_put(text, wave) != NULL)
+    speculated++;
+  else
+    delete_wave(wave);
+  pthread_mutex_unlock(&cache_lock);
+}
+
+void speech_init(cst_voice *voice) {
+  speech_voice = voice;
+
+  // Leave a core for rendering and the announcement being said
+  int workers = SDL_GetCPUCount() - 1;
+  if (workers < 1)
+    workers = 1;
+  if (workers > speech_max_predictions)
+    workers = speech_max_predictions;
+  synth_pool_start(voice, workers);
+}
+
+// What a cancelled speech_play() has to undo
+typedef struct play_state_s {
+  flite_context *context;
+  cache_entry_s *entry; // cache entry being played
+  cst_wave *wave;       // wave that didn't fit into the cache
+  int playing;
+} play_state_s;
+
+static void play_cleanup(void *arg) {
+  play_state_s *state = arg;
+
+  if (state->playing)
+    pthread_mutex_unlock(&play_lock);
+  if (state->wave != NULL)
+    delete_wave(state->wave);
+  delete_flite_context(state->context);
+
+  pthread_mutex_lock(&cache_lock);
+  if (state->entry != NULL)
+    state->entry->refs--;
+  pthread_mutex_unlock(&cache_lock);
+
+  synth_pool_pause(0);
+}
+
+// Says the text, from the cache if it has been synthesized before. Can be
+// cancelled with pthread_cancel() while synthesizing or playing.
+void speech_play(const char *text) {
+  play_state_s state = {NULL, NULL, NULL, 0};
+
+  // The background synthesis waits until this has been said
+  synth_pool_pause(1);
+  state.context = new_flite_context(speech_voice);
+  pthread_cleanup_push(play_cleanup, &state);
+
+  pthread_mutex_lock(&cache_lock);
+  state.entry = cache_find(text);
+  if (state.entry != NULL) {
+    state.entry->refs++;
+    state.entry->last_used = ++cache_clock;
+    hits++;
+  } else {
+    misses++;
+  }
+  uint32_t hit_count = hits, miss_count = misses, speculated_count = speculated;
+  int level = quality_level;
+  pthread_mutex_unlock(&cache_lock);
+
+  printf("Speech cache: %u hits, %u misses, %u speculated, quality level %d\n",
+         hit_count, miss_count, speculated_count, level);
+
+  if (state.entry == NULL) {
+    flite_feat_set_int(state.context->features, "mlsa_speed_param",
+                       speed_params[level]);
+    if (level == quality_levels - 1)
+      flite_feat_set_int(state.context->features, "mlpg_skip_frames",
+                         mlpg_skip_frames);
+
+    uint64_t start = SDL_GetPerformanceCounter();
+    cst_wave *wave = flite_context_text_to_wave(state.context, text);
+    float seconds = (float)(SDL_GetPerformanceCounter() - start) /
+                    SDL_GetPerformanceFrequency();
+
+    float rtf = 0;
+    int change = 0;
+    pthread_mutex_lock(&cache_lock);
+    if (wave != NULL && wave->num_samples > 0) {
+      rtf = seconds * wave->sample_rate / wave->num_samples;
+      change = update_quality(rtf);
+    }
+    if (wave != NULL) {
+      state.entry = cache_put(text, wave);
+      if (state.entry != NULL)
+        state.entry->refs++;
+      else
+        state.wave = wave;
+    }
+    level = quality_level;
+    pthread_mutex_unlock(&cache_lock);
+
+    if (change > 0)
+      printf("Speech synthesis is slow (%.2fx real time), quality level %d\n",
+             rtf, level);
+    else if (change < 0)
+      printf("Speech synthesis has headroom (%.2fx real time), quality level %d\n",
+             rtf, level);
+  }
+
+  pthread_mutex_lock(&play_lock);
+  state.playing = 1;
+  if (state.entry != NULL)
+    play_wave(state.entry->wave);
+  else if (state.wave != NULL)
+    play_wave(state.wave);
+  state.playing = 0;
+  pthread_mutex_unlock(&play_lock);
+
+  pthread_cleanup_pop(1);
+}
+
+// Replaces the phrases waiting to be synthesized. The first one is the most
+// likely and is synthesized first.
+void speech_predict(char phrases[][speech_phrase_length], int count) {
+  synth_pool_clear();
+
+  if (count > speech_max_predictions)
+    count = speech_max_predictions;
+
+  for (int i = 0; i < count; i++) {
+    pthread_mutex_lock(&cache_lock);
+    int cached = cache_find(phrases[i]) != NULL;
+    pthread_mutex_unlock(&cache_lock);
+
+    if (!cached)
+      synth_pool_submit(phrases[i], speculation_done, NULL);
+  }
+}
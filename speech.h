@@ -0,0 +1,14 @@
+#ifndef SPEECH_H_
+#define SPEECH_H_
+
+#include "flite/include/flite.h"
+
+#define speech_max_predictions 8
+#define speech_phrase_length 1000
+
+void speech_init(cst_voice *voice);
+void speech_play(const char *text);
+void speech_predict(char phrases[][speech_phrase_length], int count);
+void speech_get_quality(int *level, int *speed_param, float *rtf);
+
+#endif
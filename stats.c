@@ -0,0 +1,159 @@
+// Low overhead timing of the serial -> decode -> draw -> present pipeline.
+// The most recent samples of every stage are kept in a ring buffer, and the
+// p50/p99/max values are calculated from it only when the stats are shown.
+
+#include "stats.h"
+
+#include "SDL2_inprint.h"
+#include "render.h"
+#include "speech.h"
+
+#define stats_samples 512
+#define stats_max_depth 8
+
+typedef struct stats_ring_s {
+  uint32_t samples[stats_samples]; // in microseconds
+  uint32_t count;
+  uint32_t next;
+} stats_ring_s;
+
+static const char *stage_names[stats_stage_count] = {
+    "READ", "SLIP", "RECT", "CHAR", "WAVE", "RENDER", "PRESENT"};
+
+static int enabled = 0;
+static int overlay_enabled = 0;
+static uint32_t dump_interval;
+static uint32_t ticks_last_dump;
+static uint32_t ticks_last_overlay;
+
+static stats_ring_s rings[stats_stage_count];
+static double counter_to_us;
+
+// Running stages: the start time and the time used by nested stages
+static uint64_t stack_start[stats_max_depth];
+static uint64_t stack_nested[stats_max_depth];
+static int stack_depth = 0;
+
+// Overlay text, refreshed once per second
+static char overlay_lines[stats_stage_count + 1][41];
+
+void stats_enable(int overlay, uint32_t dump_interval_ms) {
+  enabled = 1;
+  overlay_enabled = overlay;
+  dump_interval = dump_interval_ms;
+  counter_to_us = 1000000.0 / SDL_GetPerformanceFrequency();
+  ticks_last_dump = SDL_GetTicks();
+  ticks_last_overlay = 0;
+}
+
+int stats_enabled() { return enabled; }
+
+void stats_begin() {
+  if (!enabled || stack_depth == stats_max_depth)
+    return;
+  stack_start[stack_depth] = SDL_GetPerformanceCounter();
+  stack_nested[stack_depth] = 0;
+  stack_depth++;
+}
+
+void stats_end(stats_stage_t stage) {
+  if (!enabled || stack_depth == 0)
+    return;
+
+  stack_depth--;
+  uint64_t elapsed = SDL_GetPerformanceCounter() - stack_start[stack_depth];
+  if (stack_depth > 0)
+    stack_nested[stack_depth - 1] += elapsed;
+
+  stats_ring_s *ring = &rings[stage];
+  ring->samples[ring->next] =
+      (uint32_t)((elapsed - stack_nested[stack_depth]) * counter_to_us);
+  ring->next = (ring->next + 1) % stats_samples;
+  if (ring->count < stats_samples)
+    ring->count++;
+}
+
+static int compare_samples(const void *a, const void *b) {
+  uint32_t x = *(const uint32_t *)a;
+  uint32_t y = *(const uint32_t *)b;
+  return (x > y) - (x < y);
+}
+
+static void percentiles(stats_ring_s *ring, uint32_t *p50, uint32_t *p99,
+                        uint32_t *max) {
+  uint32_t sorted[stats_samples];
+
+  if (ring->count == 0) {
+    *p50 = *p99 = *max = 0;
+    return;
+  }
+
+  SDL_memcpy(sorted, ring->samples, ring->count * sizeof(uint32_t));
+  SDL_qsort(sorted, ring->count, sizeof(uint32_t), compare_samples);
+
+  *p50 = sorted[ring->count / 2];
+  *p99 = sorted[(ring->count * 99) / 100];
+  *max = sorted[ring->count - 1];
+}
+
+// Refreshes the periodic log dump and the overlay text. Returns 1 if the
+// overlay has changed and the screen should be redrawn.
+int stats_update() {
+  if (!enabled)
+    return 0;
+
+  uint32_t ticks = SDL_GetTicks();
+  int dump = dump_interval > 0 && ticks - ticks_last_dump > dump_interval;
+  int refresh_overlay = overlay_enabled && ticks - ticks_last_overlay > 1000;
+
+  if (!dump && !refresh_overlay)
+    return 0;
+
+  if (dump) {
+    ticks_last_dump = ticks;
+    SDL_Log("Pipeline timings in us (p50 / p99 / max):");
+  }
+
+  if (refresh_overlay) {
+    ticks_last_overlay = ticks;
+    snprintf(overlay_lines[0], sizeof(overlay_lines[0]), "%-8s %6s %6s %6s",
+             "US", "P50", "P99", "MAX");
+  }
+
+  for (int stage = 0; stage < stats_stage_count; stage++) {
+    uint32_t p50, p99, max;
+    percentiles(&rings[stage], &p50, &p99, &max);
+
+    if (dump)
+      SDL_Log("  %-8s %6u %6u %6u", stage_names[stage], p50, p99, max);
+    if (refresh_overlay)
+      snprintf(overlay_lines[stage + 1], sizeof(overlay_lines[0]),
+               "%-8s %6u %6u %6u", stage_names[stage], p50, p99, max);
+  }
+
+  if (dump) {
+    uint32_t received, merged;
+    get_waveform_counts(&received, &merged);
+    SDL_Log("  %u oscilloscope packets, %u merged", received, merged);
+
+    int level, speed_param;
+    float rtf;
+    speech_get_quality(&level, &speed_param, &rtf);
+    SDL_Log("  speech quality level %d (mlsa_speed_param %d), %.2fx real time",
+            level, speed_param, rtf);
+  }
+
+  return refresh_overlay;
+}
+
+// Draws the timing table on top of the current render target
+void stats_draw_overlay(SDL_Renderer *renderer) {
+  if (!overlay_enabled)
+    return;
+
+  for (int line = 0; line < stats_stage_count + 1; line++) {
+    if (overlay_lines[line][0] != '\0')
+      inprint(renderer, overlay_lines[line], 8, 150 + line * 9, 0xFFFF00,
+              0x000000);
+  }
+}
@@ -0,0 +1,28 @@
+#ifndef STATS_H_
+#define STATS_H_
+
+#include <SDL.h>
+
+typedef enum stats_stage_t {
+  stats_serial_read,
+  stats_slip_decode,
+  stats_draw_rectangle,
+  stats_draw_character,
+  stats_draw_waveform,
+  stats_render,
+  stats_present,
+  stats_stage_count
+} stats_stage_t;
+
+void stats_enable(int overlay, uint32_t dump_interval_ms);
+int stats_enabled();
+
+// Time the code between stats_begin() and stats_end(). The stages can be
+// nested, the time spent in inner stages is not counted to the outer stage.
+void stats_begin();
+void stats_end(stats_stage_t stage);
+
+int stats_update();
+void stats_draw_overlay(SDL_Renderer *renderer);
+
+#endif
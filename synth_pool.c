@@ -0,0 +1,146 @@
+// A pool of threads synthesizing speech in the background. Each worker has
+// its own flite context over the shared voice, so the workers synthesize
+// concurrently with each other and with synthesis on other threads. The
+// workers run at idle priority where the platform has one.
+
+#ifdef __linux__
+#define _GNU_SOURCE
+#include <sched.h>
+#endif
+
+#include "synth_pool.h"
+
+#include <SDL_log.h>
+#include <pthread.h>
+#include <string.h>
+
+typedef struct synth_job_s {
+  char *text;
+  synth_pool_done done;
+  void *data;
+} synth_job_s;
+
+typedef struct synth_worker_s {
+  pthread_t thread;
+  flite_context *context;
+} synth_worker_s;
+
+static synth_worker_s workers[synth_pool_max_workers];
+static int worker_count = 0;
+
+// pool_lock protects everything below
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_changed = PTHREAD_COND_INITIALIZER;
+static synth_job_s jobs[synth_pool_max_jobs]; // in submission order
+static int job_count = 0;
+static int paused = 0;
+static int stopping = 0;
+
+static void *synth_worker_threadproc(void *arg) {
+  synth_worker_s *worker = arg;
+
+#ifdef SCHED_IDLE
+  struct sched_param param = {0};
+  pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+#endif
+
+  pthread_mutex_lock(&pool_lock);
+  while (1) {
+    while (!stopping && (job_count == 0 || paused > 0))
+      pthread_cond_wait(&pool_changed, &pool_lock);
+    if (stopping)
+      break;
+
+    synth_job_s job = jobs[0];
+    job_count--;
+    memmove(&jobs[0], &jobs[1], job_count * sizeof(synth_job_s));
+    pthread_mutex_unlock(&pool_lock);
+
+    cst_wave *wave = flite_context_text_to_wave(worker->context, job.text);
+    job.done(job.text, wave, job.data);
+    free(job.text);
+
+    pthread_mutex_lock(&pool_lock);
+  }
+  pthread_mutex_unlock(&pool_lock);
+
+  return NULL;
+}
+
+// Starts the workers, which share the voice. Returns the number started.
+int synth_pool_start(cst_voice *voice, int count) {
+  if (count > synth_pool_max_workers)
+    count = synth_pool_max_workers;
+
+  stopping = 0;
+  worker_count = 0;
+  for (int i = 0; i < count; i++) {
+    synth_worker_s *worker = &workers[worker_count];
+    worker->context = new_flite_context(voice);
+    if (pthread_create(&worker->thread, NULL, synth_worker_threadproc,
+                       worker) != 0) {
+      SDL_LogError(SDL_LOG_CATEGORY_SYSTEM,
+                   "Could not start speech synthesis worker");
+      delete_flite_context(worker->context);
+      break;
+    }
+    worker_count++;
+  }
+
+  return worker_count;
+}
+
+// Queues a synthesis. Returns 0 if the queue is full.
+int synth_pool_submit(const char *text, synth_pool_done done, void *data) {
+  int queued = 0;
+
+  pthread_mutex_lock(&pool_lock);
+  if (job_count < synth_pool_max_jobs) {
+    jobs[job_count].text = strdup(text);
+    jobs[job_count].done = done;
+    jobs[job_count].data = data;
+    if (jobs[job_count].text != NULL) {
+      job_count++;
+      queued = 1;
+      pthread_cond_signal(&pool_changed);
+    }
+  }
+  pthread_mutex_unlock(&pool_lock);
+
+  return queued;
+}
+
+// Drops the jobs that haven't started
+void synth_pool_clear(void) {
+  pthread_mutex_lock(&pool_lock);
+  for (int i = 0; i < job_count; i++)
+    free(jobs[i].text);
+  job_count = 0;
+  pthread_mutex_unlock(&pool_lock);
+}
+
+// Keeps the workers from starting jobs while paused. Calls nest, every
+// synth_pool_pause(1) is ended with a synth_pool_pause(0).
+void synth_pool_pause(int pause) {
+  pthread_mutex_lock(&pool_lock);
+  paused += pause ? 1 : -1;
+  if (paused == 0)
+    pthread_cond_broadcast(&pool_changed);
+  pthread_mutex_unlock(&pool_lock);
+}
+
+// Waits for the running jobs to finish, then stops the workers
+void synth_pool_stop(void) {
+  synth_pool_clear();
+
+  pthread_mutex_lock(&pool_lock);
+  stopping = 1;
+  pthread_cond_broadcast(&pool_changed);
+  pthread_mutex_unlock(&pool_lock);
+
+  for (int i = 0; i < worker_count; i++) {
+    pthread_join(workers[i].thread, NULL);
+    delete_flite_context(workers[i].context);
+  }
+  worker_count = 0;
+}
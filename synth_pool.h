@@ -0,0 +1,19 @@
+#ifndef SYNTH_POOL_H_
+#define SYNTH_POOL_H_
+
+#include "flite/include/flite.h"
+
+#define synth_pool_max_workers 8
+#define synth_pool_max_jobs 32
+
+// Called on the worker thread with the synthesized wave, which the callback
+// takes ownership of. The wave is NULL if the synthesis failed.
+typedef void (*synth_pool_done)(const char *text, cst_wave *wave, void *data);
+
+int synth_pool_start(cst_voice *voice, int workers);
+int synth_pool_submit(const char *text, synth_pool_done done, void *data);
+void synth_pool_clear(void);
+void synth_pool_pause(int pause);
+void synth_pool_stop(void);
+
+#endif
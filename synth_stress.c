@@ -0,0 +1,270 @@
+// Speech synthesis stress test, for checking that flite synthesis is
+// reentrant.
+//
+// Runs a number of threads synthesizing continuously, each with its own
+// flite_context over one shared voice, while the synth_pool workers
+// synthesize the jobs queued from the main thread. Every wave is compared
+// with the one synthesized for the same text before the threads started, so
+// a race shows up as a failure even where it doesn't crash. Build it with
+// -fsanitize=thread, for flite too, to have the races reported:
+//
+//   make clean && make CFLAGS="-g -O1 -fsanitize=thread" synth_stress
+//   ./synth_stress --seconds 30 --threads 4 --workers 2
+//
+// The workers run at idle priority, so they only get to synthesize on the
+// cores the threads leave free.
+//
+// Without --voice, or if it can't be loaded, a voice with the US English
+// front end and a cheap wave synthesis is used. That covers the text
+// analysis, the lexicon and letter to sound rules, the features and the
+// regexes, but not the CG models and the vocoder.
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "synth_pool.h"
+
+#define max_threads 64
+
+cst_lexicon *cmulex_init(void);
+void usenglish_init(cst_voice *v);
+
+// Texts like the ones flow mode says, plus some that need the text analysis
+static const char *texts[] = {
+    "Phrase . at row 00 column FX1 value",
+    "Instrument 01 sampler, filter low pass",
+    "Volume 7F at row 3 column 1234",
+    "The quick brown fox jumps over the lazy dog 42 times on 12/03/2021.",
+    "MIXER . at row CHO column VOL",
+    "Song, chain 2A, phrase 1F, instrument 0C, table 3.",
+    "Envelope 1 to cutoff, attack 00, hold 10, decay 80.",
+    "Reverb send 40, delay send C0, chorus send zero.",
+};
+#define text_count (int)(sizeof(texts) / sizeof(texts[0]))
+
+typedef struct expected_s {
+  int num_samples;
+  uint64_t hash;
+} expected_s;
+
+static cst_voice *voice;
+static expected_s expected[text_count];
+static int running = 1;
+
+// stats_lock protects everything below
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t thread_syntheses = 0;
+static uint64_t pool_syntheses = 0;
+static uint64_t failures = 0;
+
+static uint64_t now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// 64bit FNV-1a over the samples
+static uint64_t wave_hash(const cst_wave *wave) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  const uint8_t *bytes = (const uint8_t *)wave->samples;
+  size_t size = (size_t)wave->num_samples * wave->num_channels * sizeof(short);
+
+  for (size_t i = 0; i < size; i++)
+    hash = (hash ^ bytes[i]) * 0x100000001b3ULL;
+  return hash;
+}
+
+static int text_index(const char *text) {
+  for (int i = 0; i < text_count; i++)
+    if (strcmp(text, texts[i]) == 0)
+      return i;
+  return -1;
+}
+
+// Counts a synthesis, and a failure if the wave isn't the expected one
+static void check_wave(const char *text, const cst_wave *wave,
+                       uint64_t *count) {
+  int index = text_index(text);
+  int failed = wave == NULL || index < 0 ||
+               wave->num_samples != expected[index].num_samples ||
+               wave_hash(wave) != expected[index].hash;
+
+  pthread_mutex_lock(&stats_lock);
+  (*count)++;
+  if (failed) {
+    if (failures == 0)
+      fprintf(stderr, "Unexpected wave for \"%s\"\n", text);
+    failures++;
+  }
+  pthread_mutex_unlock(&stats_lock);
+}
+
+static void pool_done(const char *text, cst_wave *wave, void *data) {
+  check_wave(text, wave, &pool_syntheses);
+  if (wave != NULL)
+    delete_wave(wave);
+}
+
+static void *synth_threadproc(void *arg) {
+  int next = (int)(intptr_t)arg;
+  flite_context *context = new_flite_context(voice);
+
+  while (__atomic_load_n(&running, __ATOMIC_RELAXED)) {
+    const char *text = texts[next++ % text_count];
+    cst_wave *wave = flite_context_text_to_wave(context, text);
+    check_wave(text, wave, &thread_syntheses);
+    if (wave != NULL)
+      delete_wave(wave);
+  }
+
+  delete_flite_context(context);
+  return NULL;
+}
+
+// A wave for the front end voice, from the segments and their durations
+static cst_utterance *segment_wave(cst_utterance *utt) {
+  cst_wave *wave = new_wave();
+  const cst_item *segment;
+  int size = 0;
+
+  for (segment = relation_head(utt_relation(utt, "Segment")); segment;
+       segment = item_next(segment))
+    size += 80 + 8 * (int)strlen(item_feat_string(segment, "name"));
+
+  cst_wave_resize(wave, size, 1);
+  cst_wave_set_sample_rate(wave, 16000);
+  size = 0;
+  for (segment = relation_head(utt_relation(utt, "Segment")); segment;
+       segment = item_next(segment)) {
+    const char *name = item_feat_string(segment, "name");
+    int length = 80 + 8 * (int)strlen(name);
+    for (int i = 0; i < length; i++)
+      wave->samples[size++] = (short)(name[0] * 64 + name[i % strlen(name)]);
+  }
+
+  utt_set_wave(utt, wave);
+  return utt;
+}
+
+static cst_voice *front_end_voice() {
+  cst_voice *v = new_voice();
+  cst_lexicon *lexicon = cmulex_init();
+
+  v->name = "front_end";
+  usenglish_init(v);
+  feat_set(v->features, "lexicon", lexicon_val(lexicon));
+  feat_set(v->features, "postlex_func", uttfunc_val(lexicon->postlex));
+  feat_set_string(v->features, "no_segment_duration_model", "1");
+  feat_set_string(v->features, "no_f0_target_model", "1");
+  feat_set(v->features, "wave_synth_func", uttfunc_val(&segment_wave));
+  return v;
+}
+
+static void print_usage(const char *name) {
+  printf("Usage: %s [--seconds N] [--threads N] [--workers N] [--voice file]\n"
+         "  --seconds N   run for N seconds, default 10\n"
+         "  --threads N   threads synthesizing with their own context, "
+         "default 4\n"
+         "  --workers N   synth_pool workers, default 2\n"
+         "  --voice file  a .flitevox voice, default the front end only\n",
+         name);
+}
+
+int main(int argc, char *argv[]) {
+  int seconds = 10;
+  int thread_count = 4;
+  int worker_count = 2;
+  const char *voice_name = NULL;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+      seconds = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      thread_count = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+      worker_count = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "--voice") == 0 && i + 1 < argc) {
+      voice_name = argv[++i];
+    } else {
+      print_usage(argv[0]);
+      return 1;
+    }
+  }
+  if (seconds < 1 || thread_count < 0 || thread_count > max_threads ||
+      worker_count < 0 || worker_count > synth_pool_max_workers) {
+    print_usage(argv[0]);
+    return 1;
+  }
+
+  flite_init();
+  flite_add_lang("eng", usenglish_init, cmulex_init);
+  flite_add_lang("usenglish", usenglish_init, cmulex_init);
+
+  if (voice_name != NULL) {
+    char url[1024];
+    snprintf(url, sizeof(url), "file://%s", voice_name);
+    voice = flite_voice_select(url);
+    if (voice == NULL)
+      fprintf(stderr, "Cannot load %s, using the front end only\n",
+              voice_name);
+  }
+  if (voice == NULL)
+    voice = front_end_voice();
+
+  // The expected waves, synthesized before anything runs concurrently
+  for (int i = 0; i < text_count; i++) {
+    cst_wave *wave = flite_text_to_wave(texts[i], voice);
+    if (wave == NULL) {
+      fprintf(stderr, "Cannot synthesize \"%s\"\n", texts[i]);
+      return 1;
+    }
+    expected[i].num_samples = wave->num_samples;
+    expected[i].hash = wave_hash(wave);
+    delete_wave(wave);
+  }
+
+  printf("%d threads and %d workers for %d seconds with the %s voice\n",
+         thread_count, worker_count, seconds, voice->name);
+
+  int started_workers = synth_pool_start(voice, worker_count);
+  pthread_t threads[max_threads];
+  int started = 0;
+  for (; started < thread_count; started++)
+    if (pthread_create(&threads[started], NULL, synth_threadproc,
+                       (void *)(intptr_t)started) != 0)
+      break;
+
+  // Keep the pool busy, pausing and clearing it now and then as the speech
+  // does when an announcement interrupts the predictions
+  uint64_t end = now_ns() + (uint64_t)seconds * 1000000000ULL;
+  int next = 0;
+  for (int round = 0; started_workers > 0 && now_ns() < end; round++) {
+    while (synth_pool_submit(texts[next % text_count], pool_done, NULL))
+      next++;
+    if (round % 8 == 7) {
+      synth_pool_pause(1);
+      synth_pool_clear();
+      usleep(1000);
+      synth_pool_pause(0);
+    }
+    usleep(10000);
+  }
+  while (now_ns() < end)
+    usleep(10000);
+
+  __atomic_store_n(&running, 0, __ATOMIC_RELAXED);
+  for (int i = 0; i < started; i++)
+    pthread_join(threads[i], NULL);
+  synth_pool_stop();
+
+  printf("%llu syntheses on the threads, %llu on the workers, %llu failed\n",
+         (unsigned long long)thread_syntheses,
+         (unsigned long long)pool_syntheses, (unsigned long long)failures);
+
+  return failures == 0 && thread_syntheses + pool_syntheses > 0 ? 0 : 1;
+}